@@ -10,9 +10,12 @@
  */
 
 #include <limits.h>
+#include <float.h>
+#include <unistd.h>
 #include "ucvm_model_dtypes.h"
 #include "sjqbn.h"
 #include "sjqbn_util.h"
+#include "sjqbn_disk.h"
 #include "um_netcdf.h"
 #include "cJSON.h"
 
@@ -99,7 +102,7 @@ int sjqbn_init(const char *dir, const char *label) {
         fprintf(stderrfp, "hard disk may result in slow performance.\n");
       }
     } else if (tempVal == FAIL) {
-        sjqbn_print_error("No model file was found to read from.");
+        sjqbn_print_error("The model files could not be read.");
         return FAIL;
     }
 
@@ -130,14 +133,7 @@ if(sjqbn_ucvm_debug){ fprintf(stderrfp,"\ncalling sjqbn_query with %d numpoints\
 
     /* iterate through the dataset to see where does the point fall into */
     /* for now assume there is only 1 dataset */
-    sjqbn_dataset_t *dataset= sjqbn_velocity_model->datasets[data_idx];
-
-    float *lon_list=dataset->longitudes;
-    float *lat_list=dataset->latitudes;
-    float *dep_list=dataset->depths;
-    int nx=dataset->nx;
-    int ny=dataset->ny;
-    int nz=dataset->nz;
+    sjqbn_dataset_t *dataset= get_local_sjqbn_dataset(sjqbn_velocity_model->datasets[data_idx]);
 
     // hold current working buffers
     float *tmp_vp_buffer=NULL;
@@ -160,8 +156,6 @@ if(sjqbn_ucvm_debug){ fprintf(stderrfp,"\ncalling sjqbn_query with %d numpoints\
     int lat_idx;
     int dep_idx;
 
-    int offset;
-
     //  hold coord point's info
     sjqbn_pt_info_t *pt_info = (sjqbn_pt_info_t  *) malloc(numpoints * sizeof(sjqbn_pt_info_t));
     if (!pt_info) { fprintf(stderr, "pt_info: malloc failed\n");}
@@ -178,11 +172,12 @@ if(sjqbn_ucvm_debug){ fprintf(stderrfp,"\ncalling sjqbn_query with %d numpoints\
         pt_info[i].lat=points[i].latitude;
         pt_info[i].dep=points[i].depth;
 
-        pt_info[i].lon_idx=find_buffer_idx_clamped(lon_list,nx,pt_info[i].lon);
-        pt_info[i].lat_idx=find_buffer_idx_clamped(lat_list,ny,pt_info[i].lat);
-        pt_info[i].dep_idx=find_buffer_idx_clamped(dep_list,nz,pt_info[i].dep);
+        pt_info[i].lon_idx=sjqbn_axis_cell(&dataset->axes[SJQBN_ROI_LON],pt_info[i].lon);
+        pt_info[i].lat_idx=sjqbn_axis_cell(&dataset->axes[SJQBN_ROI_LAT],pt_info[i].lat);
+        pt_info[i].dep_idx=sjqbn_axis_cell(&dataset->axes[SJQBN_ROI_DEPTH],pt_info[i].dep);
 
-        /* check if out of range */
+        /* check if out of range, clamping only applies at the model's own edges */
+        if(outside_sjqbn_roi(dataset, &pt_info[i])) pt_info[i].lon_idx=-1;
         if(pt_info[i].lon_idx < 0 || pt_info[i].lat_idx < 0 || pt_info[i].dep_idx < 0) {
           continue;
         }
@@ -198,25 +193,36 @@ if(sjqbn_ucvm_debug){ fprintf(stderrfp,"\ncalling sjqbn_query with %d numpoints\
         if(pt_info[i].lat_idx != first_lat_idx) same_lat_idx=0;
 
         if(sjqbn_configuration->interpolation) { // fill cell percent
-            pt_info[i].lon_percent=find_cell_percent(lon_list,pt_info[i].lon,pt_info[i].lon_idx);
-            pt_info[i].lat_percent=find_cell_percent(lat_list,pt_info[i].lat,pt_info[i].lat_idx);
-            pt_info[i].dep_percent=find_cell_percent(dep_list,pt_info[i].dep,pt_info[i].dep_idx);
+            pt_info[i].lon_percent=sjqbn_axis_percent(&dataset->axes[SJQBN_ROI_LON],pt_info[i].lon,pt_info[i].lon_idx);
+            pt_info[i].lat_percent=sjqbn_axis_percent(&dataset->axes[SJQBN_ROI_LAT],pt_info[i].lat,pt_info[i].lat_idx);
+            pt_info[i].dep_percent=sjqbn_axis_percent(&dataset->axes[SJQBN_ROI_DEPTH],pt_info[i].dep,pt_info[i].dep_idx);
         }
     }
 
-    // should be in the in-memory
-    for(int i=0; i<numpoints; i++) {
-        if(!sjqbn_configuration->interpolation) {
-// no interp
-            get_one_property(dataset, &(pt_info[i]), &(data[i]));
-            } else {
-                get_interp_property(dataset, &(pt_info[i]), &(data[i]));
-        }
-    }
+    // through the dataset's storage backend
+    query_sjqbn_points(dataset, pt_info, numpoints, data, sjqbn_configuration->interpolation);
 
+    free(pt_info);
     return SUCCESS;
 }
 
+/**
+ * Blocks until every dataset is fully in memory. Only waits with
+ * async_load on, where sjqbn_init returns before the slabs are read;
+ * queries made before then wait just for the slabs they touch. Other
+ * netCDF use in the process should wait for this too.
+ *
+ * @return SUCCESS, or FAIL if part of the model could not be read.
+ */
+int sjqbn_wait_loaded() {
+    int rc=SUCCESS;
+
+    for(int i=0; i<sjqbn_velocity_model->dataset_cnt; i++) {
+        if(wait_sjqbn_dataset_fill(sjqbn_velocity_model->datasets[i]) != SUCCESS) rc=FAIL;
+    }
+    return rc;
+}
+
 /**
  */
 void sjqbn_setdebug() {
@@ -300,6 +306,11 @@ int sjqbn_read_configuration(char *file, sjqbn_configuration_t *config) {
     char value[100];
     char line_holder[128];
     config->dataset_cnt=0;
+    config->chunk_reads=1;
+    for(int a=0; a<3; a++) {
+        config->roi[a][0]=-FLT_MAX;
+        config->roi[a][1]=FLT_MAX;
+    }
 
     // If our file pointer is null, an error has occurred. Return fail.
     if (fp == NULL) { return UCVM_MODEL_CODE_ERROR; }
@@ -309,14 +320,8 @@ int sjqbn_read_configuration(char *file, sjqbn_configuration_t *config) {
         if (line_holder[0] != '#' && line_holder[0] != ' ' && line_holder[0] != '\n') {
 
          _splitline(line_holder, key, value);
+         sjqbn_set_configuration_key(config, key, value);
 
-            // Which variable are we editing?
-            if (strcmp(key, "utm_zone") == 0) config->utm_zone = atoi(value);
-            if (strcmp(key, "model_dir") == 0) sprintf(config->model_dir, "%s", value);
-            if (strcmp(key, "interpolation") == 0) { 
-                config->interpolation=0;
-                if (strcmp(value,"on") == 0) config->interpolation=1;
-            }
          /* for each dataset, allocate a model dataset's block and fill in */ 
             if (strcmp(key, "data_file") == 0) { 
                 if( config->dataset_cnt < SJQBN_DATASET_MAX) {
@@ -339,6 +344,135 @@ int sjqbn_read_configuration(char *file, sjqbn_configuration_t *config) {
     return UCVM_MODEL_CODE_SUCCESS;
 }
 
+/* "min,max" bounds of one axis, anything else (off) is the whole axis */
+static void _set_roi(float *bounds, char *value) {
+    float lo, hi;
+
+    bounds[0]=-FLT_MAX;
+    bounds[1]=FLT_MAX;
+    if (sscanf(value, "%f , %f", &lo, &hi) == 2) {
+        bounds[0]=(lo < hi) ? lo : hi;
+        bounds[1]=(lo < hi) ? hi : lo;
+    }
+}
+
+/* off, or a size with an optional K/M/G/T suffix, MB without one */
+static void _set_memory_limit(sjqbn_configuration_t *config, char *value) {
+    char *unit;
+    double size=strtod(value, &unit);
+
+    config->memory_limit=0;
+    if (unit == value || size <= 0) return;
+    switch (*unit) {
+        case 'k': case 'K': size*=1024.0; break;
+        case 'g': case 'G': size*=1024.0*1024*1024; break;
+        case 't': case 'T': size*=1024.0*1024*1024*1024; break;
+        default: size*=1024.0*1024; break;
+    }
+    config->memory_limit=(size_t)size;
+}
+
+/**
+ * Sets one storage/query parameter from a key/value pair as found in the
+ * configuration file. Unknown keys are ignored.
+ *
+ * @param config The sjqbn_configuration struct to update.
+ * @param key The parameter name.
+ * @param value The parameter value.
+ */
+void sjqbn_set_configuration_key(sjqbn_configuration_t *config, char *key, char *value) {
+    // Which variable are we editing?
+    if (strcmp(key, "utm_zone") == 0) config->utm_zone = atoi(value);
+    if (strcmp(key, "model_dir") == 0) sprintf(config->model_dir, "%s", value);
+    if (strcmp(key, "interpolation") == 0) { 
+        config->interpolation=0;
+        if (strcmp(value,"on") == 0) config->interpolation=1;
+    }
+    if (strcmp(key, "interleave") == 0) { 
+        config->interleave=0;
+        if (strcmp(value,"on") == 0) config->interleave=1;
+    }
+    if (strcmp(key, "layout") == 0) { 
+        config->layout=SJQBN_LAYOUT_SLAB;
+        if (strcmp(value,"brick") == 0) config->layout=SJQBN_LAYOUT_BRICK;
+        if (strcmp(value,"column") == 0) config->layout=SJQBN_LAYOUT_COLUMN;
+    }
+    if (strcmp(key, "brick_size") == 0) config->brick_size = atoi(value);
+    if (strcmp(key, "precision") == 0) { 
+        config->precision=SJQBN_PRECISION_FLOAT;
+        if (strcmp(value,"half") == 0) config->precision=SJQBN_PRECISION_HALF;
+        if (strcmp(value,"fixed16") == 0) config->precision=SJQBN_PRECISION_FIXED16;
+    }
+    if (strcmp(key, "model_cache") == 0) { 
+        config->model_cache=0;
+        if (strcmp(value,"on") == 0) config->model_cache=1;
+    }
+    if (strcmp(key, "shared_memory") == 0) { 
+        config->shared_memory=0;
+        if (strcmp(value,"on") == 0) config->shared_memory=1;
+    }
+    if (strcmp(key, "huge_pages") == 0) { 
+        config->huge_pages=0;
+        if (strcmp(value,"on") == 0) config->huge_pages=1;
+    }
+    if (strcmp(key, "numa") == 0) { 
+        config->numa=SJQBN_NUMA_OFF;
+        if (strcmp(value,"interleave") == 0) config->numa=SJQBN_NUMA_INTERLEAVE;
+        if (strcmp(value,"replicate") == 0) config->numa=SJQBN_NUMA_REPLICATE;
+    }
+    if (strcmp(key, "access") == 0) { 
+        config->access=SJQBN_ACCESS_MEMORY;
+        if (strcmp(value,"tiled") == 0) config->access=SJQBN_ACCESS_TILED;
+        if (strcmp(value,"auto") == 0) config->access=SJQBN_ACCESS_AUTO;
+        if (strcmp(value,"disk") == 0) config->access=SJQBN_ACCESS_DISK;
+    }
+    if (strcmp(key, "memory_limit") == 0) _set_memory_limit(config, value);
+    if (strcmp(key, "tile_size") == 0) config->tile_size = atoi(value);
+    if (strcmp(key, "tile_cache_mb") == 0) config->tile_cache_mb = atoi(value);
+    if (strcmp(key, "io_engine") == 0) { 
+        config->io_engine=SJQBN_IO_AUTO;
+        if (strcmp(value,"uring") == 0) config->io_engine=SJQBN_IO_URING;
+        if (strcmp(value,"pread") == 0) config->io_engine=SJQBN_IO_PREAD;
+    }
+    if (strcmp(key, "io_threads") == 0) config->io_threads = atoi(value);
+    if (strcmp(key, "lazy") == 0) { 
+        config->lazy=0;
+        if (strcmp(value,"on") == 0) config->lazy=1;
+    }
+    if (strcmp(key, "async_load") == 0) { 
+        config->async_load=0;
+        if (strcmp(value,"on") == 0) config->async_load=1;
+    }
+    if (strcmp(key, "rle") == 0) { 
+        config->rle=0;
+        if (strcmp(value,"on") == 0) config->rle=1;
+    }
+    if (strcmp(key, "prefetch") == 0) { 
+        config->prefetch=0;
+        if (strcmp(value,"on") == 0) config->prefetch=1;
+    }
+    if (strcmp(key, "pin_depth") == 0) { 
+        config->pin_depth=0;
+        if (strcmp(value,"off") != 0) config->pin_depth=atof(value);
+    }
+    if (strcmp(key, "fault_stats") == 0) { 
+        config->fault_stats=0;
+        if (strcmp(value,"on") == 0) config->fault_stats=1;
+    }
+    if (strcmp(key, "backend") == 0) {
+        config->backend[0]='\0';
+        if (strcmp(value,"off") != 0) snprintf(config->backend, sizeof(config->backend), "%s", value);
+    }
+    if (strcmp(key, "load_threads") == 0) config->load_threads = atoi(value);
+    if (strcmp(key, "chunk_reads") == 0) { 
+        config->chunk_reads=0;
+        if (strcmp(value,"on") == 0) config->chunk_reads=1;
+    }
+    if (strcmp(key, "roi_lon") == 0) _set_roi(config->roi[SJQBN_ROI_LON], value);
+    if (strcmp(key, "roi_lat") == 0) _set_roi(config->roi[SJQBN_ROI_LAT], value);
+    if (strcmp(key, "roi_depth") == 0) _set_roi(config->roi[SJQBN_ROI_DEPTH], value);
+}
+
 /**
  * Extract sjqbn netcdf dataset specific info
  * and fill in the model info, one dataset at a time
@@ -413,15 +547,27 @@ void _splitline(char* lptr, char key[], char value[]) {
  * setup the dataset's content 
  * and fill in the model info, one dataset at a time
  * and allocate required memory space
+ * FAIL, with nothing left loaded, when one of them can not be
  *
  * */
 int sjqbn_read_model(sjqbn_configuration_t *config, sjqbn_model_t *model, char *datadir) {
 
     int max_idx=model->dataset_cnt; // how many datasets are there
     for(int i=0; i<max_idx;i++) { 
-        sjqbn_dataset_t *data=make_a_sjqbn_dataset(datadir, config->dataset_files[i], TooBig); 
+        sjqbn_dataset_t *data=make_a_sjqbn_dataset(config, datadir, config->dataset_files[i], TooBig); 
 // put into the velocity model
         model->datasets[i]=data;
+        if(data == NULL) {
+            for(int j=0; j<i; j++) {
+                free_sjqbn_dataset(model->datasets[j]);
+                model->datasets[j]=NULL;
+            }
+            return FAIL;
+        }
+    }
+// background loading starts once no more files are being opened
+    for(int i=0; i<max_idx;i++) { 
+        start_sjqbn_dataset_fill(model->datasets[i]);
     }
     return SUCCESS;
 }
@@ -478,15 +624,43 @@ void sjqbn_print_error(char *err) {
 }
 
 /*
- * Check if the data is too big to be loaded internally (exceed maximum
- * allowable by a INT variable)
+ * Memory a model may take: memory_limit if set and smaller, else what
+ * the kernel reports available (MemAvailable, free pages without it).
+ *
+ */
+size_t sjqbn_memory_budget(sjqbn_configuration_t *config) {
+    size_t avail= (size_t) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    char line[128];
+    size_t kb;
+
+    FILE *fp=fopen("/proc/meminfo", "r");
+    if(fp != NULL) {
+        while(fgets(line, sizeof(line), fp) != NULL) {
+            if(sscanf(line, "MemAvailable: %zu kB", &kb) == 1) {
+                avail=kb * 1024;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    if(config != NULL && config->memory_limit > 0 && config->memory_limit < avail) {
+        return config->memory_limit;
+    }
+    return avail;
+}
+
+/*
+ * Check if the data is too big to be loaded internally, the float
+ * volumes of vp/vs/rho would not fit in the node's physical memory.
+ * Indexing is 64 bit, so the grid's node count alone is no limit.
  *
  */
-static int too_big(sjqbn_dataset_t *dataset) {
-    long max_size= (long) (dataset->nx) * dataset->ny * dataset->nz;
-    long delta= max_size - INT_MAX;
+int sjqbn_too_big(sjqbn_dataset_t *dataset) {
+    size_t max_size= (size_t) (dataset->nx) * dataset->ny * dataset->nz;
+    size_t bytes= max_size * SJQBN_PROP_CNT * sizeof(float);
+    size_t phys= (size_t) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
 
-    if( delta > 0) {
+    if( bytes > phys) {
         return 1;
         } else {
             return 0;
@@ -29,6 +29,7 @@
 
 extern int sjqbn_ucvm_debug;
 extern FILE *stderrfp;
+extern char sjqbn_data_directory[128];
 
 // Structures
 /** Defines a point (latitude, longitude, and depth) in WGS84 format */
@@ -72,6 +73,60 @@ typedef struct sjqbn_configuration_t {
         /** GTL on or off (1 or 0) */
 	/** interpolation on or off (1 or 0) */
         int interpolation;
+        /** pack vp/vs/rho of a grid node into one record (1 or 0) */
+        int interleave;
+        /** in-memory node ordering, SJQBN_LAYOUT_SLAB/BRICK/COLUMN */
+        int layout;
+        /** edge length of a brick, power of 2 */
+        int brick_size;
+        /** stored precision, SJQBN_PRECISION_FLOAT/HALF/FIXED16 */
+        int precision;
+        /** keep/use a mapped binary image next to the netCDF file (1 or 0) */
+        int model_cache;
+        /** share one copy of the model between processes on a node (1 or 0) */
+        int shared_memory;
+        /** put the property volumes on 2MB pages (1 or 0) */
+        int huge_pages;
+        /** NUMA placement, SJQBN_NUMA_OFF/INTERLEAVE/REPLICATE */
+        int numa;
+        /** where queries read the properties, SJQBN_ACCESS_MEMORY/TILED/DISK,
+            or SJQBN_ACCESS_AUTO to pick the storage from memory_limit */
+        int access;
+        /** bytes an auto access model may take, 0 for what is available */
+        size_t memory_limit;
+        /** edge length of a disk tile, power of 2 */
+        int tile_size;
+        /** memory budget of the tile cache in MB */
+        int tile_cache_mb;
+        /** how disk access reads, SJQBN_IO_AUTO/URING/PREAD */
+        int io_engine;
+        /** pread threads of disk access, 0 for SJQBN_DISK_THREADS */
+        int io_threads;
+        /** fill each depth slab on first query instead of at init (1 or 0) */
+        int lazy;
+        /** return from init with the axes loaded and read the slabs in
+            on a background thread (1 or 0) */
+        int async_load;
+        /** keep each depth column as runs of equal vp/vs/rho (1 or 0) */
+        int rle;
+        /** advise the pages a query batch touches in a mapped image
+            before reading them (1 or 0) */
+        int prefetch;
+        /** lock the dense storage from the surface down to this depth
+            in memory, 0 for none */
+        float pin_depth;
+        /** count the page faults of each query batch (1 or 0) */
+        int fault_stats;
+        /** storage backend by name, empty for the one the keys above pick */
+        char backend[32];
+        /** threads reading the volumes at init, 0 for one per cpu */
+        int load_threads;
+        /** read in chunk aligned hyperslabs with a tuned chunk cache (1),
+            or each variable whole with nc_get_var_float (0) */
+        int chunk_reads;
+        /** region of interest, min/max along SJQBN_ROI_LON/LAT/DEPTH,
+            -/+FLT_MAX for the whole axis */
+        float roi[3][2];
 
         /* how many datasets are in the model */
         int dataset_cnt;
@@ -129,11 +184,14 @@ int sjqbn_finalize();
 int sjqbn_version(char *ver, int len);
 /** Queries the model */
 int sjqbn_query(sjqbn_point_t *points, sjqbn_properties_t *data, int numpts);
+/** Waits for a background (async_load) model load to finish */
+int sjqbn_wait_loaded();
 
 // Non-UCVM Helper Functions
 //
 /** Reads the configuration file and helper functions. */
 int sjqbn_read_configuration(char *file, sjqbn_configuration_t *config);
+void sjqbn_set_configuration_key(sjqbn_configuration_t *config, char *key, char *value);
 int sjqbn_configuration_finalize(sjqbn_configuration_t *config);
 
 /** Prints out the error string. */
@@ -144,6 +202,10 @@ void sjqbn_read_properties(int x, int y, int z, sjqbn_properties_t *data);
 int sjqbn_read_model(sjqbn_configuration_t *config, sjqbn_model_t *model, char* dir);
 /** toggle debug flag **/
 void sjqbn_setdebug();
+/** grid's volumes would not fit in physical memory **/
+int sjqbn_too_big(sjqbn_dataset_t *dataset);
+/** memory a model may take, memory_limit or what is available **/
+size_t sjqbn_memory_budget(sjqbn_configuration_t *config);
 
 /** helper function for velocity_model **/
 int sjqbn_velocity_model_init(sjqbn_model_t *model);
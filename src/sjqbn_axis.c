@@ -0,0 +1,218 @@
+/**
+         sjqbn_axis.c
+
+   Every query point needs its cell along each axis. The grids this
+   model ships on are uniform, where the cell follows from one multiply
+   and a check against the nodes. Other axes get the same through a
+   table of narrow buckets, unless it would be too large; those are
+   searched. Points come along lines and profiles, so the search first
+   gallops out from the cell the thread found last on that axis, and
+   only then descends the nodes in Eytzinger order, without branches
+   and prefetching the next levels. The reciprocal cell widths spare
+   the division in the interpolation fractions.
+**/
+
+#include "sjqbn.h"
+#include "um_netcdf.h"
+#include "sjqbn_axis.h"
+
+/* last cell, and lookups left that go without it after a miss; a slot
+   handed on to a new axis starts from whatever its last axis left */
+static __thread struct { int cell; int skip; } _hints[SJQBN_AXIS_HINTS];
+static uint64_t _slots_used=0;
+#if SJQBN_AXIS_HINTS > 64
+#error "SJQBN_AXIS_HINTS slots are one bit each of _slots_used"
+#endif
+
+static int _take_slot(void) {
+    uint64_t all=(SJQBN_AXIS_HINTS < 64) ? (1ULL << SJQBN_AXIS_HINTS) - 1 : ~0ULL;
+    uint64_t used=__atomic_load_n(&_slots_used, __ATOMIC_RELAXED);
+
+    while((used & all) != all) {
+        int slot=__builtin_ctzll(~used);
+        if(__atomic_compare_exchange_n(&_slots_used, &used, used | (1ULL << slot), 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return slot;
+    }
+    return -1;
+}
+
+/* table of the cell each bucket starts in, buckets half the smallest
+   cell wide so that v is at most one node away from its bucket start */
+static int _setup_lut(sjqbn_axis_t *axis) {
+    float *a=axis->values;
+    int n=axis->n;
+    double gap=(double)a[1] - a[0];
+
+    for(int i=1; i<n-1; i++) {
+        if((double)a[i+1] - a[i] < gap) gap=(double)a[i+1] - a[i];
+    }
+    if(!(gap > 0)) return SUCCESS;
+
+    double width=gap / 2;
+    double cnt=ceil(((double)a[n-1] - a[0]) / width) + 1;
+    if(cnt > SJQBN_AXIS_LUT_MAX) return SUCCESS;
+
+    axis->lut_cnt=(int)cnt;
+    axis->lut=(int32_t *)malloc(axis->lut_cnt * sizeof(int32_t));
+    if(axis->lut == NULL) return FAIL;
+    for(int b=0, i=0; b<axis->lut_cnt; b++) {
+        double start=a[0] + b*width;
+        while(i < n-2 && a[i+1] <= start) i++;
+        axis->lut[b]=i;
+    }
+    axis->scale=1.0 / width;
+    axis->bias=-a[0] / width;
+    return SUCCESS;
+}
+
+/* in-order walk of the implicit tree, hands out the sorted nodes */
+static int _fill_eytz(sjqbn_axis_t *axis, int i, int k) {
+    if(k <= axis->n) {
+        i=_fill_eytz(axis, i, 2*k);
+        axis->eytz[k]=axis->values[i];
+        axis->eytz_idx[k]=i++;
+        i=_fill_eytz(axis, i, 2*k+1);
+    }
+    return i;
+}
+
+static int _setup_eytz(sjqbn_axis_t *axis) {
+    if(posix_memalign((void **)&axis->eytz, 64, (axis->n+1) * sizeof(float)) != 0) {
+        axis->eytz=NULL;
+        return FAIL;
+    }
+    axis->eytz_idx=(int32_t *)malloc((axis->n+1) * sizeof(int32_t));
+    if(axis->eytz_idx == NULL) {
+        free(axis->eytz);
+        axis->eytz=NULL;
+        return FAIL;
+    }
+    _fill_eytz(axis, 0, 1);
+    axis->hint_slot=_take_slot();
+    axis->eytz_idx[0]=0;  // no node above v, only NaN gets here
+    return SUCCESS;
+}
+
+/**
+ * Sets up the lookup of an ascending axis. It is uniform when every
+ * node is within SJQBN_AXIS_UNIFORM_TOL steps of where an even spacing
+ * puts it.
+ *
+ * @return SUCCESS or FAIL when out of memory
+ */
+int setup_sjqbn_axis(sjqbn_axis_t *axis, float *values, int n) {
+    memset(axis, 0, sizeof(sjqbn_axis_t));
+    axis->hint_slot=-1;
+    axis->values=values;
+    axis->n=n;
+    if(n < 2) return SUCCESS;
+
+    axis->inv_step=(float *)malloc((n-1) * sizeof(float));
+    if(axis->inv_step == NULL) return FAIL;
+    for(int i=0; i<n-1; i++) axis->inv_step[i]=1.0f / (values[i+1] - values[i]);
+
+    double step=((double)values[n-1] - values[0]) / (n-1);
+    axis->uniform=(step > 0);
+    for(int i=0; i<n && axis->uniform; i++) {
+        if(fabs(values[i] - (values[0] + i*step)) > SJQBN_AXIS_UNIFORM_TOL * step) axis->uniform=0;
+        if(i > 0 && values[i] <= values[i-1]) axis->uniform=0;
+    }
+    if(axis->uniform) {
+        axis->scale=1.0 / step;
+        axis->bias=-values[0] / step;
+        return SUCCESS;
+    }
+    if(_setup_lut(axis) != SUCCESS) return FAIL;
+    return (axis->lut == NULL) ? _setup_eytz(axis) : SUCCESS;
+}
+
+void free_sjqbn_axis(sjqbn_axis_t *axis) {
+    if(axis->hint_slot >= 0) __atomic_fetch_and(&_slots_used, ~(1ULL << axis->hint_slot), __ATOMIC_RELAXED);
+    axis->hint_slot=-1;
+    free(axis->lut);
+    free(axis->eytz);
+    free(axis->eytz_idx);
+    free(axis->inv_step);
+    axis->lut=NULL;
+    axis->eytz=NULL;
+    axis->eytz_idx=NULL;
+    axis->inv_step=NULL;
+}
+
+/* cell of v between nodes lo and hi, values[lo] <= v < values[hi] */
+static int _bracket(const float *a, int lo, int hi, float v) {
+    while(hi - lo > 1) {
+        int mid=lo + (hi - lo) / 2;
+        if(a[mid] <= v) {
+            lo=mid;
+            } else {
+                hi=mid;
+        }
+    }
+    return lo;
+}
+
+/* doubling steps out from cell h, -1 when v is further off */
+static int _gallop(const sjqbn_axis_t *axis, int h, float v) {
+    const float *a=axis->values;
+    int last=axis->n - 2;
+    int step=1;
+
+    if(h < 0 || h > last) h=0;  // from an axis that shared the slot
+    if(a[h] <= v) {
+        if(v < a[h+1]) return h;
+        int lo=h+1;
+        for(int g=0; g<SJQBN_AXIS_GALLOP; g++, step*=2) {
+            int hi=(lo + step < last+1) ? lo + step : last+1;
+            if(v < a[hi]) return _bracket(a, lo, hi, v);
+            lo=hi;
+        }
+        } else {
+            int hi=h;
+            for(int g=0; g<SJQBN_AXIS_GALLOP; g++, step*=2) {
+                int lo=(hi - step > 0) ? hi - step : 0;
+                if(a[lo] <= v) return _bracket(a, lo, hi, v);
+                hi=lo;
+            }
+    }
+    return -1;
+}
+
+/* the node above v from the root of the Eytzinger order down; past the
+   leaves, the trailing right turns lead back up to it */
+static int _descend(const sjqbn_axis_t *axis, float v) {
+    const float *b=axis->eytz;
+    int n=axis->n;
+    int k=1;
+
+    if(b == NULL) return find_buffer_idx_clamped(axis->values, n, v);
+    while(k <= n) {
+        __builtin_prefetch(b + 16*k);  // the next four levels, a line of 16 nodes
+        k=2*k + (b[k] <= v);
+    }
+    k>>=__builtin_ffs(~k);
+
+    int i=axis->eytz_idx[k] - 1;
+    return (i < 0) ? 0 : i;
+}
+
+/**
+ * Cell of v strictly inside a non-uniform axis. Scattered points would
+ * otherwise each wait on the node at the last cell before searching,
+ * so after a miss the hint sits out SJQBN_AXIS_BACKOFF lookups.
+ */
+int sjqbn_axis_search(const sjqbn_axis_t *axis, float v) {
+    int slot=axis->hint_slot;
+    int i=-1;
+
+    if(slot < 0) return _descend(axis, v);
+    if(_hints[slot].skip > 0) {
+        _hints[slot].skip--;
+        } else {
+            i=_gallop(axis, _hints[slot].cell, v);
+            if(i < 0) _hints[slot].skip=SJQBN_AXIS_BACKOFF;
+    }
+    if(i < 0) i=_descend(axis, v);
+    _hints[slot].cell=i;
+    return i;
+}
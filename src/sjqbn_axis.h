@@ -0,0 +1,94 @@
+/**
+ * @file sjqbn_axis.h
+ *
+ * cell lookup along the longitude, latitude and depth axes, set up
+ * once per axis at load
+ *
+**/
+
+#ifndef SJQBN_AXIS_H
+#define SJQBN_AXIS_H
+
+#include <stdint.h>
+
+/* most a node may sit off the uniform grid, in steps, for the axis to
+   be looked up arithmetically */
+#define SJQBN_AXIS_UNIFORM_TOL 0.1
+/* most entries in the bucket table of a non-uniform axis; one that
+   would need more is searched instead */
+#define SJQBN_AXIS_LUT_MAX 65536
+/* searched axes: last cell found per axis and thread, one slot to each
+   axis while it lives; axes beyond this many at once go without */
+#define SJQBN_AXIS_HINTS 64
+/* doublings tried outward from the last cell before a full search */
+#define SJQBN_AXIS_GALLOP 4
+/* lookups that skip the hint after it missed */
+#define SJQBN_AXIS_BACKOFF 8
+
+typedef struct sjqbn_axis_t {
+        float *values;   /* ascending nodes, owned by the dataset */
+        int n;
+
+        /* uniform axes: the cell of v is v*scale+bias rounded down,
+           give or take one checked against the nodes */
+        int uniform;
+        double scale;
+        double bias;
+
+        /* non-uniform axes: the same, v*scale+bias is a bucket narrower
+           than half the smallest cell and lut[] the cell of its start */
+        int32_t *lut;
+        int lut_cnt;
+
+        /* axes with neither: the nodes in Eytzinger (breadth first)
+           order from [1] on, with their index in values */
+        float *eytz;
+        int32_t *eytz_idx;
+        int hint_slot;   /* -1 when it has none */
+
+        /* 1/(values[i+1]-values[i]) per cell */
+        float *inv_step;
+} sjqbn_axis_t;
+
+int setup_sjqbn_axis(sjqbn_axis_t *axis, float *values, int n);
+void free_sjqbn_axis(sjqbn_axis_t *axis);
+int sjqbn_axis_search(const sjqbn_axis_t *axis, float v);
+
+/**
+ * Cell i with values[i] <= v < values[i+1], the first or last cell
+ * for v off either end, as find_buffer_idx_clamped gives.
+ */
+static inline int sjqbn_axis_cell(const sjqbn_axis_t *axis, float v) {
+    const float *a=axis->values;
+    int last=axis->n - 2;
+
+    if(last < 0) return -1;
+    if(v <= a[0]) return 0;
+    if(v >= a[last+1]) return last;
+    if(!axis->uniform && axis->lut == NULL) return sjqbn_axis_search(axis, v);
+
+    double t=v * axis->scale + axis->bias;
+    int i;
+    if(axis->uniform) {
+        i=(t > 0) ? ((t < last) ? (int)t : last) : 0;
+        } else {
+            int b=(t > 0) ? ((t < axis->lut_cnt-1) ? (int)t : axis->lut_cnt-1) : 0;
+            i=axis->lut[b];
+    }
+    if(a[i] > v) {
+        i--;
+        } else if(a[i+1] <= v) {
+            i++;
+    }
+    return i;
+}
+
+/* where v sits between the nodes of cell i, 0 to 1 */
+static inline float sjqbn_axis_percent(const sjqbn_axis_t *axis, float v, int i) {
+    float percent=(v - axis->values[i]) * axis->inv_step[i];
+    if(percent < 0.0) percent=0;
+    if(percent > 1.0) percent=1.0;
+    return percent;
+}
+
+#endif
@@ -0,0 +1,49 @@
+/**
+         sjqbn_backend.c
+
+   Registry of storage backends. The built in ones are always there;
+   others are added with sjqbn_register_backend before sjqbn_init and
+   picked with the backend key of the configuration.
+**/
+
+#include "ucvm_model_dtypes.h"
+#include "sjqbn.h"
+#include "sjqbn_backend.h"
+
+static const sjqbn_backend_t *sjqbn_backends[SJQBN_BACKEND_MAX]={
+    &sjqbn_dense_backend, &sjqbn_lazy_backend, &sjqbn_tiled_backend, &sjqbn_rle_backend,
+    &sjqbn_disk_backend
+};
+static int sjqbn_backend_cnt=5;
+
+/**
+ * Adds a backend. It must have load, fetch_node and fetch_corners, and
+ * stay valid while any model uses it.
+ *
+ * @return SUCCESS, or FAIL if the name is taken or the registry full
+ */
+int sjqbn_register_backend(const sjqbn_backend_t *backend) {
+    if(backend == NULL || backend->name == NULL || backend->load == NULL ||
+              backend->fetch_node == NULL || backend->fetch_corners == NULL) {
+        fprintf(stderr, "sjqbn: incomplete storage backend\n");
+        return FAIL;
+    }
+    if(sjqbn_find_backend(backend->name) != NULL) {
+        fprintf(stderr, "sjqbn: storage backend %s already registered\n", backend->name);
+        return FAIL;
+    }
+    if(sjqbn_backend_cnt == SJQBN_BACKEND_MAX) {
+        fprintf(stderr, "sjqbn: no room for storage backend %s\n", backend->name);
+        return FAIL;
+    }
+    sjqbn_backends[sjqbn_backend_cnt++]=backend;
+    return SUCCESS;
+}
+
+/* the backend registered under name, NULL if none */
+const sjqbn_backend_t *sjqbn_find_backend(const char *name) {
+    for(int i=0; i<sjqbn_backend_cnt; i++) {
+        if(strcmp(sjqbn_backends[i]->name, name) == 0) return sjqbn_backends[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file sjqbn_backend.h
+ *
+ * storage backends: where a dataset's vp/vs/rho live and how the query
+ * engine fetches them
+ *
+**/
+
+#ifndef SJQBN_BACKEND_H
+#define SJQBN_BACKEND_H
+
+#include "sjqbn_util.h"
+
+#define SJQBN_BACKEND_MAX 16
+/* points handed to a batch fetch at a time */
+#define SJQBN_FETCH_BATCH 64
+
+/**
+ * A storage backend. Points come with their grid indices set and
+ * already checked by the engine: in the grid for fetch_node, with the
+ * whole cell in the grid for fetch_corners. Values go out as vp/vs/rho,
+ * corners in the order of the trilinear kernel: x fastest, then y,
+ * then z. Fetches return SUCCESS or FAIL, a point that fails gets the
+ * no data markers.
+ *
+ * The batch fetches may be NULL, the engine then loops over the single
+ * ones. A batch has at most SJQBN_FETCH_BATCH points, those with
+ * lon_idx < 0 are to be skipped.
+ */
+typedef struct sjqbn_backend_t {
+        const char *name;
+        /** build the storage, the axes are read and data->ncid is open */
+        int (*load)(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath);
+        /** free what load built, may be NULL */
+        void (*release)(sjqbn_dataset_t *data);
+
+        int (*fetch_node)(sjqbn_dataset_t *data, sjqbn_pt_info_t *pt, float *val);
+        int (*fetch_corners)(sjqbn_dataset_t *data, sjqbn_pt_info_t *pt, float (*val)[8]);
+        /** batch fetches, rc[i] is the outcome for pts[i] */
+        void (*fetch_nodes)(sjqbn_dataset_t *data, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT], int *rc);
+        void (*fetch_corner_sets)(sjqbn_dataset_t *data, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT][8], int *rc);
+        /** batch of cells interpolated by the backend as their corners
+            come in, points it fails get the no data markers; may be NULL,
+            fetch_corner_sets is used then */
+        void (*fetch_interp)(sjqbn_dataset_t *data, sjqbn_pt_info_t *pts, int n, sjqbn_properties_t *out);
+} sjqbn_backend_t;
+
+/* built in, picked by the access/lazy/async_load/rle keys, or by name
+   with backend; a dense dataset leaves its backend NULL so the engine
+   runs its inlined kernels */
+extern const sjqbn_backend_t sjqbn_dense_backend;
+extern const sjqbn_backend_t sjqbn_lazy_backend;
+extern const sjqbn_backend_t sjqbn_tiled_backend;
+extern const sjqbn_backend_t sjqbn_rle_backend;
+extern const sjqbn_backend_t sjqbn_disk_backend;
+
+int sjqbn_register_backend(const sjqbn_backend_t *backend);
+const sjqbn_backend_t *sjqbn_find_backend(const char *name);
+
+#endif
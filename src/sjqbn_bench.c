@@ -0,0 +1,289 @@
+/*
+ * @file sjqbn_bench.c
+ * @brief Times SJQBN queries against the in-memory storage variants.
+ * @author - SCEC
+ * @version 1.0
+ *
+ * Loads the model once as UCVM would, then rebuilds the datasets under
+ * each storage variant and times sjqbn_query on the same set of points.
+ * Results are checked against the first variant. With -c every variant
+ * is also loaded from a second copy of the model files, say contiguous
+ * next to chunked, so the two file layouts are timed in one run.
+ *
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <assert.h>
+#include <unistd.h>
+#include "ucvm_model_dtypes.h"
+#include "sjqbn.h"
+#include "sjqbn_tiles.h"
+
+#define BENCH_BATCH 1000
+#define BENCH_KEYS_MAX 8
+
+/** A storage variant, as config file lines applied on top of the loaded config */
+typedef struct bench_variant_t {
+	char *name;
+	char *keys[BENCH_KEYS_MAX];
+} bench_variant_t;
+
+/* storage keys reset before each variant is applied */
+char *bench_defaults[] = { "layout = slab", "brick_size = 8", "interleave = off", "precision = float", "huge_pages = off",
+                          "access = memory", "memory_limit = off", "tile_size = 16", "tile_cache_mb = 256", "io_engine = auto",
+                          "io_threads = 0", "model_cache = off", "prefetch = off", "pin_depth = off", "fault_stats = off", "lazy = off", "async_load = off", "rle = off", "chunk_reads = on", NULL };
+
+bench_variant_t bench_variants[] = {
+	{ "slab",              { NULL } },
+	{ "slab+interleave",   { "interleave = on", NULL } },
+	{ "brick4",            { "layout = brick", "brick_size = 4", NULL } },
+	{ "brick8",            { "layout = brick", NULL } },
+	{ "brick8+interleave", { "layout = brick", "interleave = on", NULL } },
+	{ "column",            { "layout = column", NULL } },
+	{ "column+interleave", { "layout = column", "interleave = on", NULL } },
+	{ "half",              { "precision = half", NULL } },
+	{ "half+interleave",   { "precision = half", "interleave = on", NULL } },
+	{ "fixed16",           { "precision = fixed16", NULL } },
+	{ "slab+hugepages",    { "huge_pages = on", NULL } },
+	{ "brick8+hugepages",  { "layout = brick", "huge_pages = on", NULL } },
+	{ "slab+getvar",       { "chunk_reads = off", NULL } },
+	{ "brick8+getvar",     { "layout = brick", "chunk_reads = off", NULL } },
+	{ "lazy",              { "lazy = on", NULL } },
+	{ "async",             { "async_load = on", NULL } },
+	{ "rle",               { "rle = on", NULL } },
+	{ "tiled16",           { "access = tiled", NULL } },
+	{ "tiled16+4MB",       { "access = tiled", "tile_cache_mb = 4", NULL } },
+	{ "tiled8+4MB",        { "access = tiled", "tile_size = 8", "tile_cache_mb = 4", NULL } },
+	{ "mapped",            { "model_cache = on", "fault_stats = on", NULL } },
+	{ "mapped+prefetch",   { "model_cache = on", "fault_stats = on", "prefetch = on", NULL } },
+	{ "mapped+pin2km",     { "model_cache = on", "fault_stats = on", "pin_depth = 2000", NULL } },
+	{ "disk",              { "access = disk", NULL } },
+	{ "disk+pread",        { "access = disk", "io_engine = pread", NULL } },
+	{ "auto",              { "access = auto", NULL } },
+	{ "auto+100MB",        { "access = auto", "memory_limit = 100M", NULL } },
+	{ "auto+32MB",         { "access = auto", "memory_limit = 32M", NULL } },
+	{ NULL, { NULL } }
+};
+
+/* Usage function */
+void usage() {
+  printf("     sjqbn_bench - (c) SCEC\n");
+  printf("Time SJQBN queries under each storage variant\n");
+  printf("\tusage: sjqbn_bench [-h] [-n npoints] [-w scatter|profile] [-v variant] [-t threads] [-c datadir]\n\n");
+  printf("Flags:\n");
+  printf("\t-n number of query points (default 1000000)\n");
+  printf("\t-w workload, scatter (random points) or profile (depth columns)\n");
+  printf("\t-v only run the named variant\n");
+  printf("\t-t load_threads for every variant, also prints the load phases\n");
+  printf("\t-c also load every variant from datadir, holding the model files under\n");
+  printf("\t   the same names but stored otherwise, e.g. contiguous from nccopy -k\n");
+  printf("\t   classic or rechunked with nccopy -c; its rows are marked [-c]\n");
+  printf("\t-h usage\n\n");
+  printf("Output format is:\n");
+  printf("\tvariant load(s) query(ns/pt) maxdiff(vp vs rho)\n\n");
+  exit (0);
+}
+
+extern char *optarg;
+extern int optind, opterr, optopt;
+
+double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double _urand(double lo, double hi) {
+  return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+}
+
+/* points inside the dataset's extent, scattered or as depth columns */
+void make_points(sjqbn_dataset_t *dataset, sjqbn_point_t *pt, int numpts, int profile) {
+  float *lon=dataset->longitudes;
+  float *lat=dataset->latitudes;
+  float *dep=dataset->depths;
+  int nz=dataset->nz;
+
+  srand(1);
+  for(int i=0; i<numpts; i++) {
+    if(profile && (i % nz) != 0) {
+      pt[i].longitude=pt[i-1].longitude;
+      pt[i].latitude=pt[i-1].latitude;
+      pt[i].depth=dep[0] + (dep[nz-1]-dep[0]) * (i % nz) / nz;
+      continue;
+    }
+    pt[i].longitude=_urand(lon[0], lon[dataset->nx-1]);
+    pt[i].latitude=_urand(lat[0], lat[dataset->ny-1]);
+    pt[i].depth=profile ? dep[0] : _urand(dep[0], dep[nz-1]);
+  }
+}
+
+void apply_keys(sjqbn_configuration_t *config, char **keys) {
+  char key[40], value[100], line[128];
+  for(int k=0; keys[k] != NULL; k++) {
+    strcpy(line, keys[k]);
+    _splitline(line, key, value);
+    sjqbn_set_configuration_key(config, key, value);
+  }
+}
+
+void run_query(sjqbn_point_t *pt, sjqbn_properties_t *ret, int numpts) {
+  for(int i=0; i<numpts; i+=BENCH_BATCH) {
+    int cnt=(numpts-i < BENCH_BATCH) ? numpts-i : BENCH_BATCH;
+    sjqbn_query(&pt[i], &ret[i], cnt);
+  }
+}
+
+/**
+ * Runs every storage variant over the same points.
+ *
+ * @param argc The number of arguments.
+ * @param argv The argument strings.
+ * @return A zero value indicating success.
+ */
+int main(int argc, char* const argv[]) {
+	int numpts=1000000;
+	int profile=0;
+	char *only=NULL;
+	char threads_key[40];
+	char *threads_keys[2]={ NULL, NULL };
+	char *compare=NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:w:v:t:c:h")) != -1) {
+	  switch (opt) {
+	  case 'n':
+	    numpts=atoi(optarg);
+	    break;
+	  case 'w':
+	    profile=(strcmp(optarg,"profile") == 0);
+	    break;
+	  case 'v':
+	    only=optarg;
+	    break;
+	  case 't':
+	    snprintf(threads_key, sizeof(threads_key), "load_threads = %d", atoi(optarg));
+	    threads_keys[0]=threads_key;
+	    break;
+	  case 'c':
+	    compare=optarg;
+	    break;
+	  case 'h':
+	    usage();
+	    break;
+	  default: /* '?' */
+	    usage();
+	    exit(1);
+	  }
+	}
+
+	if(compare != NULL && access(compare, R_OK | X_OK) != 0) {
+	  fprintf(stderr, "sjqbn_bench: can not read %s\n", compare);
+	  exit(1);
+	}
+
+	// Initialize the model. 
+	char *envstr=getenv("UCVM_INSTALL_PATH");
+	if(envstr != NULL) {
+	   assert(sjqbn_init(envstr, "sjqbn") == 0);
+	   } else {
+	     assert(sjqbn_init("..", "sjqbn") == 0);
+	}
+	assert(sjqbn_wait_loaded() == 0);
+
+	sjqbn_point_t *pt = malloc(numpts * sizeof(sjqbn_point_t));
+	sjqbn_properties_t *ref = malloc(numpts * sizeof(sjqbn_properties_t));
+	sjqbn_properties_t *ret = malloc(numpts * sizeof(sjqbn_properties_t));
+	assert(pt && ref && ret);
+
+	make_points(sjqbn_velocity_model->datasets[0], pt, numpts, profile);
+	printf("# %d %s points, interpolation %s\n", numpts, profile ? "profile" : "scatter",
+	       sjqbn_configuration->interpolation ? "on" : "off");
+	sjqbn_dataset_t *first=sjqbn_velocity_model->datasets[0];
+	printf("# file storage %s %zux%zux%zu%s\n", first->chunked ? "chunked" : "contiguous",
+	       first->chunks[0], first->chunks[1], first->chunks[2], first->deflated ? " deflated" : "");
+
+	sjqbn_model_t *loaded=sjqbn_velocity_model;
+	char *dirs[2]={ sjqbn_data_directory, compare };
+	int have_ref=0;
+	int compare_shown=0;
+
+	for(int v=0; bench_variants[v].name != NULL; v++) {
+	  bench_variant_t *var=&bench_variants[v];
+	  if(only != NULL && strcmp(only, var->name) != 0) continue;
+
+	  for(int d=0; d<2; d++) {
+	    if(dirs[d] == NULL) continue;
+	    char name[64];
+	    snprintf(name, sizeof(name), "%s%s", var->name, d ? " [-c]" : "");
+
+	    sjqbn_configuration_t config=*sjqbn_configuration;
+	    apply_keys(&config, bench_defaults);
+	    apply_keys(&config, var->keys);
+	    apply_keys(&config, threads_keys);
+
+	    sjqbn_model_t model;
+	    sjqbn_velocity_model_init(&model);
+	    model.dataset_cnt=loaded->dataset_cnt;
+
+	    double t0=_now();
+	    if(sjqbn_read_model(&config, &model, dirs[d]) != SUCCESS) {
+	      printf("%-20s failed to load\n", name);
+	      continue;
+	    }
+	    double t1=_now();
+	    if(d && !compare_shown) {
+	      sjqbn_dataset_t *other=model.datasets[0];
+	      printf("# [-c] %s, file storage %s %zux%zux%zu%s\n", compare, other->chunked ? "chunked" : "contiguous",
+	             other->chunks[0], other->chunks[1], other->chunks[2], other->deflated ? " deflated" : "");
+	      compare_shown=1;
+	    }
+
+	    sjqbn_velocity_model=&model;
+	    run_query(pt, ret, numpts);    // warm up
+	    double t2=_now();
+	    run_query(pt, ret, numpts);
+	    double t3=_now();
+	    sjqbn_velocity_model=loaded;
+
+	    double diff[3]={0, 0, 0};
+	    if(!have_ref) {
+	      memcpy(ref, ret, numpts * sizeof(sjqbn_properties_t));
+	      have_ref=1;
+	    }
+	    for(int i=0; i<numpts; i++) {
+	      diff[0]=fmax(diff[0], fabs(ret[i].vp - ref[i].vp));
+	      diff[1]=fmax(diff[1], fabs(ret[i].vs - ref[i].vs));
+	      diff[2]=fmax(diff[2], fabs(ret[i].rho - ref[i].rho));
+	    }
+
+	    printf("%-20s %8.3f %10.1f   %g %g %g\n", name, t1-t0,
+	           (t3-t2) * 1e9 / numpts, diff[0], diff[1], diff[2]);
+	    if(threads_keys[0] != NULL) {
+	      double *ph=model.datasets[0]->load_seconds;
+	      printf("%-20s load phases axes %.3f volumes %.3f pack %.3f\n", "", ph[SJQBN_PHASE_AXES],
+	             ph[SJQBN_PHASE_VOLUMES], ph[SJQBN_PHASE_PACK]);
+	    }
+	    sjqbn_tile_cache_t *tiles=model.datasets[0]->tiles;
+	    if(tiles != NULL) {
+	      printf("%-20s tile cache %ld hits %ld misses (%.2f%%), %d slots\n", "", tiles->hits, tiles->misses,
+	             100.0 * tiles->misses / (tiles->hits + tiles->misses), tiles->slot_cnt);
+	    }
+	    sjqbn_dataset_t *ds=model.datasets[0];
+	    if(ds->batches > 0) {
+	      printf("%-20s page faults %ld major %ld minor in %ld batches, %zu MB pinned\n", "", ds->major_faults,
+	             ds->minor_faults, ds->batches, ds->pinned_bytes >> 20);
+	    }
+	    sjqbn_velocity_model_finalize(&model);
+	  }
+	}
+
+	free(pt);
+	free(ref);
+	free(ret);
+	assert(sjqbn_finalize() == 0);
+	return 0;
+}
@@ -0,0 +1,433 @@
+/**
+         sjqbn_cache.c
+
+   A loaded dataset is written once as a flat image next to the netCDF
+   file: a header then page aligned sections holding the axes and the
+   property storage exactly as the query kernels use it. Later inits
+   map the image read-only and point the dataset into it, so startup
+   skips netCDF decoding and processes on a node share the page cache.
+   The same image also backs the node-wide shared memory segment.
+**/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "ucvm_model_dtypes.h"
+#include "sjqbn.h"
+#include "sjqbn_cache.h"
+
+/* where each section lives in a dataset */
+static void **_section_ptr(sjqbn_dataset_t *data, int sec) {
+    switch(sec) {
+        case SJQBN_SEC_LON: return (void **)&data->longitudes;
+        case SJQBN_SEC_LAT: return (void **)&data->latitudes;
+        case SJQBN_SEC_DEP: return (void **)&data->depths;
+        case SJQBN_SEC_VP: return (void **)&data->vp_buffer;
+        case SJQBN_SEC_VS: return (void **)&data->vs_buffer;
+        case SJQBN_SEC_RHO: return (void **)&data->rho_buffer;
+        case SJQBN_SEC_RECORDS: return (void **)&data->records;
+        case SJQBN_SEC_PACKED_VP: return (void **)&data->packed[SJQBN_VP_IDX];
+        case SJQBN_SEC_PACKED_VS: return (void **)&data->packed[SJQBN_VS_IDX];
+        case SJQBN_SEC_PACKED_RHO: return (void **)&data->packed[SJQBN_RHO_IDX];
+        case SJQBN_SEC_PACKED_RECORDS: return (void **)&data->packed_records;
+        case SJQBN_SEC_SLAB_BASE: return (void **)&data->slab_base;
+        case SJQBN_SEC_SLAB_SCALE: return (void **)&data->slab_scale;
+        case SJQBN_SEC_NODE_VALID: return (void **)&data->node_valid;
+        default: return (void **)&data->cell_valid;
+    }
+}
+
+static size_t _section_length(sjqbn_dataset_t *data, int sec) {
+    size_t nodes=data->store_elems;
+    switch(sec) {
+        case SJQBN_SEC_LON: return data->nx * sizeof(float);
+        case SJQBN_SEC_LAT: return data->ny * sizeof(float);
+        case SJQBN_SEC_DEP: return data->nz * sizeof(float);
+        case SJQBN_SEC_VP:
+        case SJQBN_SEC_VS:
+        case SJQBN_SEC_RHO: return nodes * sizeof(float);
+        case SJQBN_SEC_RECORDS: return nodes * SJQBN_PROP_CNT * sizeof(float);
+        case SJQBN_SEC_PACKED_VP:
+        case SJQBN_SEC_PACKED_VS:
+        case SJQBN_SEC_PACKED_RHO: return nodes * sizeof(uint16_t);
+        case SJQBN_SEC_PACKED_RECORDS: return nodes * SJQBN_PROP_CNT * sizeof(uint16_t);
+        case SJQBN_SEC_NODE_VALID:
+        case SJQBN_SEC_CELL_VALID: return (((size_t)data->nx * data->ny * data->nz + 63) >> 6) * sizeof(uint64_t);
+        default: return (size_t)SJQBN_PROP_CNT * data->nz * sizeof(float);
+    }
+}
+
+static size_t _align(size_t off) {
+    return (off + SJQBN_CACHE_ALIGN-1) & ~((size_t)SJQBN_CACHE_ALIGN-1);
+}
+
+/* check the image header at base against the netCDF file and the
+   configuration, then map it and point a copy of the dataset into it */
+static int _map_image(sjqbn_dataset_t *data, sjqbn_configuration_t *config, int fd, off_t base, size_t len, const char *srcpath) {
+    struct stat src_st;
+    sjqbn_cache_header_t hdr;
+
+    if(stat(srcpath, &src_st) != 0) return FAIL;
+
+    if(len < sizeof(hdr) || pread(fd, &hdr, sizeof(hdr), base) != sizeof(hdr)) {
+        return FAIL;
+    }
+
+    if(memcmp(hdr.magic, SJQBN_CACHE_MAGIC, 8) != 0 || hdr.version != SJQBN_CACHE_VERSION ||
+              hdr.source_size != src_st.st_size || hdr.source_mtime != src_st.st_mtime ||
+              hdr.interleaved != config->interleave || hdr.precision != config->precision ||
+              memcmp(hdr.roi, config->roi, sizeof(hdr.roi)) != 0) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," image is stale\n");
+        return FAIL;
+    }
+
+    sjqbn_dataset_t probe=*data;
+    probe.nx=hdr.nx;
+    probe.ny=hdr.ny;
+    probe.nz=hdr.nz;
+    memcpy(probe.roi, hdr.roi, sizeof(probe.roi));
+    setup_sjqbn_layout(&probe, config->layout, config->brick_size);
+    if(probe.layout != hdr.layout || probe.brick_shift != hdr.brick_shift || probe.store_elems != hdr.store_elems) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," image has another layout\n");
+        return FAIL;
+    }
+
+    for(int sec=0; sec<SJQBN_SEC_CNT; sec++) {
+        if(hdr.sec_length[sec] != 0 &&
+              (hdr.sec_length[sec] != _section_length(&probe, sec) || hdr.sec_offset[sec] + hdr.sec_length[sec] > len)) {
+            return FAIL;
+        }
+    }
+
+    void *map=mmap(NULL, len, PROT_READ, MAP_SHARED, fd, base);
+    if(map == MAP_FAILED) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," image mmap failed (%s)\n", strerror(errno));
+        return FAIL;
+    }
+
+    *data=probe;
+    for(int sec=0; sec<SJQBN_SEC_CNT; sec++) {
+        *_section_ptr(data, sec)= hdr.sec_length[sec] ? (char *)map + hdr.sec_offset[sec] : NULL;
+    }
+    data->interleaved=hdr.interleaved;
+    data->precision=hdr.precision;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) data->quant_error[p]=hdr.quant_error[p];
+    data->elems=(size_t)hdr.nx * hdr.ny * hdr.nz;
+    data->cache_map=map;
+    data->cache_map_len=len;
+    return SUCCESS;
+}
+
+/* write the dataset as an image at base, returns the image length or 0 */
+static size_t _write_image(sjqbn_dataset_t *data, int fd, off_t base, const char *srcpath) {
+    struct stat src_st;
+    sjqbn_cache_header_t hdr;
+
+    if(stat(srcpath, &src_st) != 0) return 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SJQBN_CACHE_MAGIC, 8);
+    hdr.version=SJQBN_CACHE_VERSION;
+    hdr.nx=data->nx;
+    hdr.ny=data->ny;
+    hdr.nz=data->nz;
+    memcpy(hdr.roi, data->roi, sizeof(hdr.roi));
+    hdr.layout=data->layout;
+    hdr.brick_shift=data->brick_shift;
+    hdr.interleaved=data->interleaved;
+    hdr.precision=data->precision;
+    hdr.store_elems=data->store_elems;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) hdr.quant_error[p]=data->quant_error[p];
+    hdr.source_size=src_st.st_size;
+    hdr.source_mtime=src_st.st_mtime;
+
+    size_t off=_align(sizeof(hdr));
+    for(int sec=0; sec<SJQBN_SEC_CNT; sec++) {
+        if(*_section_ptr(data, sec) == NULL) continue;
+        hdr.sec_offset[sec]=off;
+        hdr.sec_length[sec]=_section_length(data, sec);
+        off=_align(off + hdr.sec_length[sec]);
+    }
+
+    if(ftruncate(fd, base + off) != 0) return 0;
+    if(pwrite(fd, &hdr, sizeof(hdr), base) != sizeof(hdr)) return 0;
+    for(int sec=0; sec<SJQBN_SEC_CNT; sec++) {
+        char *ptr=*_section_ptr(data, sec);
+        size_t done=0;
+        while(ptr != NULL && done < hdr.sec_length[sec]) {
+            ssize_t n=pwrite(fd, ptr+done, hdr.sec_length[sec]-done, base+hdr.sec_offset[sec]+done);
+            if(n <= 0) return 0;
+            done+=n;
+        }
+    }
+    return off;
+}
+
+/**
+ * Looks for a current image made from the netCDF file for the
+ * configuration's region of interest, whatever its storage, and sets
+ * the configuration's layout, interleave and precision to that of the
+ * image so sjqbn_cache_attach takes it.
+ *
+ * @return the image length, 0 if there is none
+ */
+size_t sjqbn_cache_probe(sjqbn_configuration_t *config, const char *cachepath, const char *srcpath) {
+    struct stat st, src_st;
+    sjqbn_cache_header_t hdr;
+    size_t len=0;
+
+    int fd=open(cachepath, O_RDONLY);
+    if(fd < 0) return 0;
+
+    if(fstat(fd, &st) == 0 && stat(srcpath, &src_st) == 0 &&
+              pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+              memcmp(hdr.magic, SJQBN_CACHE_MAGIC, 8) == 0 && hdr.version == SJQBN_CACHE_VERSION &&
+              hdr.source_size == src_st.st_size && hdr.source_mtime == src_st.st_mtime &&
+              memcmp(hdr.roi, config->roi, sizeof(hdr.roi)) == 0) {
+        config->layout=hdr.layout;
+        if(hdr.layout == SJQBN_LAYOUT_BRICK) config->brick_size=1 << hdr.brick_shift;
+        config->interleave=hdr.interleaved;
+        config->precision=hdr.precision;
+        len=st.st_size;
+    }
+    close(fd);
+    return len;
+}
+
+/**
+ * Maps an existing image read-only and points the dataset into it.
+ * The image is used only if it was made from the same netCDF file
+ * (size and mtime) with the storage the configuration asks for.
+ *
+ * @return SUCCESS or FAIL, on FAIL the dataset is untouched
+ */
+int sjqbn_cache_attach(sjqbn_dataset_t *data, sjqbn_configuration_t *config, const char *cachepath, const char *srcpath) {
+    struct stat st;
+
+    int fd=open(cachepath, O_RDONLY);
+    if(fd < 0) return FAIL;
+
+    int rc=FAIL;
+    if(fstat(fd, &st) == 0) {
+        rc=_map_image(data, config, fd, 0, st.st_size, srcpath);
+    }
+    close(fd);
+
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," cache image %s %s\n", cachepath, rc == SUCCESS ? "mapped" : "not used");
+    return rc;
+}
+
+/**
+ * Writes the dataset as an image. It goes to a temporary name and is
+ * renamed into place, so concurrent inits never see a partial image.
+ *
+ * @return SUCCESS or FAIL
+ */
+int sjqbn_cache_write(sjqbn_dataset_t *data, const char *cachepath, const char *srcpath) {
+    char tmppath[300];
+
+    snprintf(tmppath, sizeof(tmppath), "%s.%d", cachepath, (int)getpid());
+    int fd=open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," can not write cache image %s (%s)\n", tmppath, strerror(errno));
+        return FAIL;
+    }
+
+    size_t len=_write_image(data, fd, 0, srcpath);
+    close(fd);
+
+    if(len == 0 || rename(tmppath, cachepath) != 0) {
+        unlink(tmppath);
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," failed writing cache image %s\n", cachepath);
+        return FAIL;
+    }
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," wrote cache image %s (%zu bytes)\n", cachepath, len);
+    return SUCCESS;
+}
+
+/* unmap the image, the dataset's section pointers are gone with it */
+void sjqbn_cache_detach(sjqbn_dataset_t *data) {
+    if(data->cache_map == NULL) return;
+    munmap(data->cache_map, data->cache_map_len);
+    data->cache_map=NULL;
+    data->cache_map_len=0;
+    for(int sec=0; sec<SJQBN_SEC_CNT; sec++) {
+        *_section_ptr(data, sec)=NULL;
+    }
+}
+
+/**** node-wide shared segment ****/
+/* The segment holds a control block in its first page and the image
+   after it. flock on the segment serialises creation and the
+   reference count; a segment whose loader died is not ready and gets
+   replaced by the next process. A segment is never truncated in place,
+   others may have it mapped: a stale one is unlinked and a fresh one
+   made under its name, the old one lives on until its last user is
+   gone. Each process keeps its descriptor to tell the two apart.
+
+   A process that dies attached never drops its reference, and the
+   segment then outlives the last user. The next run of the same model
+   attaches to it; one for a model file that has since changed has to
+   be removed by hand, rm /dev/shm/sjqbn_* with no model users left. */
+
+/* name from the netCDF file, its size and mtime, and the storage, so
+   differently stored copies of one file and a rebuilt file do not
+   collide */
+static void _shm_name(sjqbn_configuration_t *config, const char *srcpath, char *name, size_t len) {
+    char desc[400];
+    struct stat st;
+    uint64_t h=1469598103934665603ULL; // FNV-1a
+
+    if(stat(srcpath, &st) != 0) memset(&st, 0, sizeof(st));
+    snprintf(desc, sizeof(desc), "%s|%lld|%lld.%09ld|%d|%d|%d|%d|%a|%a|%a|%a|%a|%a", srcpath,
+             (long long)st.st_size, (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+             config->layout, config->brick_size, config->interleave, config->precision,
+             config->roi[0][0], config->roi[0][1], config->roi[1][0], config->roi[1][1],
+             config->roi[2][0], config->roi[2][1]);
+    for(char *c=desc; *c; c++) {
+        h ^= (unsigned char)*c;
+        h *= 1099511628211ULL;
+    }
+    snprintf(name, len, "/sjqbn_%016llx", (unsigned long long)h);
+}
+
+static int _shm_control(int fd, sjqbn_shm_control_t *ctl, int store) {
+    ssize_t n= store ? pwrite(fd, ctl, sizeof(*ctl), 0) : pread(fd, ctl, sizeof(*ctl), 0);
+    return (n == sizeof(*ctl)) ? SUCCESS : FAIL;
+}
+
+/* whether fd is still the segment under name, not one since replaced */
+static int _shm_current(const char *name, int fd) {
+    struct stat a, b;
+    int cur=shm_open(name, O_RDONLY, 0);
+
+    if(cur < 0) return 0;
+    int same=(fstat(fd, &a) == 0 && fstat(cur, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino);
+    close(cur);
+    return same;
+}
+
+/**
+ * Attaches to this file's node-wide segment, or becomes its owner.
+ *
+ * @return SJQBN_SHM_ATTACHED when the dataset now points into a ready
+ *   segment, SJQBN_SHM_OWNER when the caller must load the dataset and
+ *   call sjqbn_shm_publish (the segment lock is held until then), or
+ *   FAIL when shared memory can not be used.
+ */
+int sjqbn_shm_open(sjqbn_dataset_t *data, sjqbn_configuration_t *config, const char *srcpath) {
+    sjqbn_shm_control_t ctl;
+    struct stat st;
+
+    _shm_name(config, srcpath, data->shm_name, sizeof(data->shm_name));
+    for(int tries=0; tries<SJQBN_SHM_TRIES; tries++) {
+        int fd=shm_open(data->shm_name, O_RDWR | O_CREAT, 0644);
+        if(fd < 0) {
+            if(sjqbn_ucvm_debug) fprintf(stderrfp," shm_open %s failed (%s)\n", data->shm_name, strerror(errno));
+            break;
+        }
+        flock(fd, LOCK_EX);
+
+        // replaced while this one waited for the lock
+        if(!_shm_current(data->shm_name, fd) || fstat(fd, &st) != 0) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            continue;
+        }
+
+        if(st.st_size > SJQBN_CACHE_ALIGN &&
+                  _shm_control(fd, &ctl, 0) == SUCCESS && ctl.ready &&
+                  memcmp(ctl.magic, SJQBN_CACHE_MAGIC, 8) == 0 &&
+                  _map_image(data, config, fd, SJQBN_CACHE_ALIGN, st.st_size - SJQBN_CACHE_ALIGN, srcpath) == SUCCESS) {
+            ctl.refcnt++;
+            _shm_control(fd, &ctl, 1);
+            flock(fd, LOCK_UN);
+            data->shm_fd=fd;
+            if(sjqbn_ucvm_debug) fprintf(stderrfp," attached segment %s (%d users)\n", data->shm_name, ctl.refcnt);
+            return SJQBN_SHM_ATTACHED;
+        }
+
+        if(st.st_size == 0) {  // first here
+            data->shm_fd=fd;
+            if(sjqbn_ucvm_debug) fprintf(stderrfp," creating segment %s\n", data->shm_name);
+            return SJQBN_SHM_OWNER;
+        }
+
+        // stale, or its loader died: leave it to whoever maps it and start over
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," replacing stale segment %s\n", data->shm_name);
+        shm_unlink(data->shm_name);
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+    data->shm_name[0]='\0';
+    return FAIL;
+}
+
+/**
+ * Copies a loaded dataset into the segment opened by sjqbn_shm_open,
+ * marks it ready and releases the lock. On success mapped points into
+ * the segment and the caller can drop its private copy. With mapped
+ * NULL nothing is published, for storage that has no image to give.
+ *
+ * @return SUCCESS or FAIL, on FAIL the segment is removed
+ */
+int sjqbn_shm_publish(sjqbn_dataset_t *data, sjqbn_configuration_t *config, const char *srcpath, sjqbn_dataset_t *mapped) {
+    sjqbn_shm_control_t ctl;
+    int fd=data->shm_fd;
+    int rc=FAIL;
+
+    memset(&ctl, 0, sizeof(ctl));
+    memcpy(ctl.magic, SJQBN_CACHE_MAGIC, 8);
+
+    size_t len=(mapped != NULL && data->tiles == NULL) ? _write_image(data, fd, SJQBN_CACHE_ALIGN, srcpath) : 0;
+    if(len != 0) {
+        ctl.ready=1;
+        ctl.refcnt=1;
+        *mapped=*data;
+        if(_shm_control(fd, &ctl, 1) == SUCCESS &&
+                  _map_image(mapped, config, fd, SJQBN_CACHE_ALIGN, len, srcpath) == SUCCESS) {
+            rc=SUCCESS;
+        }
+    }
+
+    data->shm_fd=-1;
+    flock(fd, LOCK_UN);
+    if(rc != SUCCESS) {
+        shm_unlink(data->shm_name);
+        close(fd);
+        data->shm_name[0]='\0';
+        if(mapped != NULL) mapped->shm_name[0]='\0';
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," failed creating segment\n");
+        } else {
+            mapped->shm_fd=fd;  // kept for sjqbn_shm_release
+    }
+    return rc;
+}
+
+/* drop this process's reference, the last one out removes the segment
+   unless it has been replaced already */
+void sjqbn_shm_release(sjqbn_dataset_t *data) {
+    sjqbn_shm_control_t ctl;
+    int fd=data->shm_fd;
+
+    if(data->shm_name[0] == '\0') return;
+    if(fd >= 0) {
+        flock(fd, LOCK_EX);
+        if(_shm_control(fd, &ctl, 0) == SUCCESS) {
+            ctl.refcnt--;
+            if(ctl.refcnt <= 0) {
+                if(_shm_current(data->shm_name, fd)) shm_unlink(data->shm_name);
+                } else {
+                    _shm_control(fd, &ctl, 1);
+            }
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+    data->shm_fd=-1;
+    data->shm_name[0]='\0';
+}
@@ -0,0 +1,79 @@
+/**
+ * @file sjqbn_cache.h
+ *
+ * flat binary image of a loaded dataset, kept next to its netCDF file
+ * and mapped read-only by later inits, or shared node-wide through a
+ * POSIX shared memory segment
+ *
+**/
+
+#ifndef SJQBN_CACHE_H
+#define SJQBN_CACHE_H
+
+#include <stdint.h>
+#include "sjqbn_util.h"
+
+#define SJQBN_CACHE_MAGIC "SJQBNIMG"
+#define SJQBN_CACHE_VERSION 3
+#define SJQBN_CACHE_SUFFIX ".cache"
+/* every section starts on a page boundary */
+#define SJQBN_CACHE_ALIGN 4096
+
+/* sections of the image, in file order */
+enum {
+    SJQBN_SEC_LON=0, SJQBN_SEC_LAT, SJQBN_SEC_DEP,
+    SJQBN_SEC_VP, SJQBN_SEC_VS, SJQBN_SEC_RHO,
+    SJQBN_SEC_RECORDS,
+    SJQBN_SEC_PACKED_VP, SJQBN_SEC_PACKED_VS, SJQBN_SEC_PACKED_RHO,
+    SJQBN_SEC_PACKED_RECORDS,
+    SJQBN_SEC_SLAB_BASE, SJQBN_SEC_SLAB_SCALE,
+    SJQBN_SEC_NODE_VALID, SJQBN_SEC_CELL_VALID,
+    SJQBN_SEC_CNT
+};
+
+typedef struct sjqbn_cache_header_t {
+        char magic[8];
+        int32_t version;
+        /* grid */
+        int32_t nx;
+        int32_t ny;
+        int32_t nz;
+        /* region of interest the grid was cut to */
+        float roi[3][2];
+        /* storage the volumes were written in */
+        int32_t layout;
+        int32_t brick_shift;
+        int32_t interleaved;
+        int32_t precision;
+        uint64_t store_elems;
+        float quant_error[SJQBN_PROP_CNT];
+        /* the netCDF file this image was made from */
+        int64_t source_size;
+        int64_t source_mtime;
+        /* byte offset and length of each section, 0 length if absent */
+        uint64_t sec_offset[SJQBN_SEC_CNT];
+        uint64_t sec_length[SJQBN_SEC_CNT];
+} sjqbn_cache_header_t;
+
+/* first page of a shared segment, the image follows at SJQBN_CACHE_ALIGN */
+typedef struct sjqbn_shm_control_t {
+        char magic[8];
+        int32_t ready;   /* image complete */
+        int32_t refcnt;  /* processes attached */
+} sjqbn_shm_control_t;
+
+#define SJQBN_SHM_ATTACHED 2
+#define SJQBN_SHM_OWNER 3
+/* rounds of finding a segment replaced under its name before giving up */
+#define SJQBN_SHM_TRIES 4
+
+size_t sjqbn_cache_probe(sjqbn_configuration_t *config, const char *cachepath, const char *srcpath);
+int sjqbn_cache_attach(sjqbn_dataset_t *data, sjqbn_configuration_t *config, const char *cachepath, const char *srcpath);
+int sjqbn_cache_write(sjqbn_dataset_t *data, const char *cachepath, const char *srcpath);
+void sjqbn_cache_detach(sjqbn_dataset_t *data);
+
+int sjqbn_shm_open(sjqbn_dataset_t *data, sjqbn_configuration_t *config, const char *srcpath);
+int sjqbn_shm_publish(sjqbn_dataset_t *data, sjqbn_configuration_t *config, const char *srcpath, sjqbn_dataset_t *mapped);
+void sjqbn_shm_release(sjqbn_dataset_t *data);
+
+#endif
@@ -0,0 +1,634 @@
+/**
+         sjqbn_disk.c
+
+   Disk resident mode for random queries. The model is written once as
+   a tiled image, a cache image in brick layout with the tile as brick
+   and vp/vs/rho records interleaved, so the 8 corners of a cell mostly
+   sit in one or two blocks of it. A query batch sorts the records it
+   needs by file position, gathers the distinct blocks and reads them
+   all in one submission, SJQBN_DISK_QUEUE at a time, so the device
+   sees a deep queue instead of one synchronous read per value. Records
+   are handed out as their blocks complete, so the caller interpolates
+   a point while the reads for the others are still in flight.
+
+   Reads go through io_uring, set up with the raw system calls so there
+   is no liburing dependency, or where the kernel lacks it through a
+   pool of threads doing pread. Each batch in flight has its own
+   context, buffers and ring, so concurrent queries do not serialize.
+**/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+
+#include "ucvm_model_dtypes.h"
+#include "sjqbn.h"
+#include "um_netcdf.h"
+#include "sjqbn_cache.h"
+#include "sjqbn_disk.h"
+
+#define SJQBN_DISK_RECORD (SJQBN_PROP_CNT * sizeof(float))
+
+/* one batch in flight */
+typedef struct sjqbn_disk_ctx_t {
+        struct sjqbn_disk_ctx_t *next;  /* idle or pool work list */
+        char *buf;                      /* SJQBN_DISK_QUEUE blocks */
+        off_t block[SJQBN_DISK_QUEUE];  /* block held by each buffer slot */
+        int res[SJQBN_DISK_QUEUE];      /* SUCCESS or FAIL per slot */
+        char got[SJQBN_DISK_QUEUE];     /* slot read and handed out */
+        int cnt;                        /* slots of the current round */
+        int claimed;                    /* pool: slots taken by a reader */
+        int done;                       /* pool: slots read */
+        int order[SJQBN_DISK_QUEUE];    /* pool: slots in the order read */
+
+        /* records wanted, sorted by offset, first[s] is the first
+           starting in slot s, first[cnt] the end of the round */
+        struct sjqbn_disk_want_t *want;
+        int want_cap;
+        int first[SJQBN_DISK_QUEUE+1];
+        /* where the batch's records go */
+        float *out;
+        int *rc;
+        sjqbn_disk_ready_fn ready;
+        void *arg;
+
+        /* io_uring, ring < 0 without */
+        int ring;
+        void *sq_map;
+        size_t sq_map_len;
+        void *cq_map;
+        size_t cq_map_len;
+        struct io_uring_sqe *sqes;
+        size_t sqes_len;
+        unsigned *sq_tail;
+        unsigned *sq_mask;
+        unsigned *sq_array;
+        unsigned *cq_head;
+        unsigned *cq_tail;
+        unsigned *cq_mask;
+        struct io_uring_cqe *cqes;
+        struct iovec iov[SJQBN_DISK_QUEUE];
+} sjqbn_disk_ctx_t;
+
+typedef struct sjqbn_disk_want_t {
+        size_t offset;  /* node offset in the brick layout */
+        int idx;        /* place in the caller's arrays */
+        int pos;        /* byte of the record in the context buffer */
+} sjqbn_disk_want_t;
+
+static size_t _disk_align(size_t off) {
+    return (off + SJQBN_CACHE_ALIGN-1) & ~((size_t)SJQBN_CACHE_ALIGN-1);
+}
+
+static int _pwrite_all(int fd, const void *buf, size_t len, off_t off) {
+    size_t done=0;
+    while(done < len) {
+        ssize_t n=pwrite(fd, (const char *)buf + done, len - done, off + done);
+        if(n <= 0) return FAIL;
+        done+=n;
+    }
+    return SUCCESS;
+}
+
+/**** tiled image ****/
+/* header the image of the dataset's region of interest has */
+static void _disk_header(sjqbn_dataset_t *data, struct stat *src_st, sjqbn_cache_header_t *hdr) {
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, SJQBN_CACHE_MAGIC, 8);
+    hdr->version=SJQBN_CACHE_VERSION;
+    hdr->nx=data->nx;
+    hdr->ny=data->ny;
+    hdr->nz=data->nz;
+    memcpy(hdr->roi, data->roi, sizeof(hdr->roi));
+    hdr->layout=SJQBN_LAYOUT_BRICK;
+    hdr->brick_shift=data->brick_shift;
+    hdr->interleaved=1;
+    hdr->precision=SJQBN_PRECISION_FLOAT;
+    hdr->store_elems=data->store_elems;
+    hdr->source_size=src_st->st_size;
+    hdr->source_mtime=src_st->st_mtime;
+
+    size_t off=_disk_align(sizeof(*hdr));
+    hdr->sec_offset[SJQBN_SEC_LON]=off;
+    hdr->sec_length[SJQBN_SEC_LON]=data->nx * sizeof(float);
+    off=_disk_align(off + hdr->sec_length[SJQBN_SEC_LON]);
+    hdr->sec_offset[SJQBN_SEC_LAT]=off;
+    hdr->sec_length[SJQBN_SEC_LAT]=data->ny * sizeof(float);
+    off=_disk_align(off + hdr->sec_length[SJQBN_SEC_LAT]);
+    hdr->sec_offset[SJQBN_SEC_DEP]=off;
+    hdr->sec_length[SJQBN_SEC_DEP]=data->nz * sizeof(float);
+    off=_disk_align(off + hdr->sec_length[SJQBN_SEC_DEP]);
+    hdr->sec_offset[SJQBN_SEC_RECORDS]=off;
+    hdr->sec_length[SJQBN_SEC_RECORDS]=data->store_elems * SJQBN_DISK_RECORD;
+}
+
+/**
+ * Writes the tiled image of a dataset set up in brick layout, reading
+ * the netCDF file one row of tiles at a time so memory stays small
+ * whatever the model size. It goes to a temporary name and is renamed
+ * into place like a cache image.
+ *
+ * @return SUCCESS or FAIL
+ */
+int sjqbn_disk_write(sjqbn_dataset_t *data, const char *path, const char *srcpath) {
+    char tmppath[300];
+    struct stat src_st;
+    sjqbn_cache_header_t hdr;
+    int varids[SJQBN_PROP_CNT]={ data->vp_varid, data->vs_varid, data->rho_varid };
+
+    if(stat(srcpath, &src_st) != 0) return FAIL;
+    _disk_header(data, &src_st, &hdr);
+
+    int shift=data->brick_shift;
+    int edge=1 << shift;
+    int ntz=(data->nz + edge-1) >> shift;
+    size_t tile_nodes=(size_t)edge * edge * edge;
+    size_t row_nodes=(size_t)data->nbx * tile_nodes;
+    size_t end=_disk_align(hdr.sec_offset[SJQBN_SEC_RECORDS] + hdr.sec_length[SJQBN_SEC_RECORDS]);
+
+    snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int)getpid());
+    int fd=open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        fprintf(stderr, "sjqbn: can not write tiled image %s (%s)\n", tmppath, strerror(errno));
+        return FAIL;
+    }
+
+    float *row=(float *)malloc(row_nodes * SJQBN_DISK_RECORD);
+    float *slab=(float *)malloc((size_t)edge * edge * data->nx * sizeof(float));
+    int rc=(row != NULL && slab != NULL && ftruncate(fd, end) == 0 &&
+            _pwrite_all(fd, &hdr, sizeof(hdr), 0) == SUCCESS &&
+            _pwrite_all(fd, data->longitudes, hdr.sec_length[SJQBN_SEC_LON], hdr.sec_offset[SJQBN_SEC_LON]) == SUCCESS &&
+            _pwrite_all(fd, data->latitudes, hdr.sec_length[SJQBN_SEC_LAT], hdr.sec_offset[SJQBN_SEC_LAT]) == SUCCESS &&
+            _pwrite_all(fd, data->depths, hdr.sec_length[SJQBN_SEC_DEP], hdr.sec_offset[SJQBN_SEC_DEP]) == SUCCESS) ? SUCCESS : FAIL;
+
+    // each row of tiles is contiguous in the image, padding stays 0
+    for(int tz=0; tz<ntz && rc == SUCCESS; tz++) {
+        for(int ty=0; ty<data->nby && rc == SUCCESS; ty++) {
+            size_t start[3]={ (size_t)data->z0 + ((size_t)tz << shift), (size_t)data->y0 + ((size_t)ty << shift), data->x0 };
+            size_t count[3];
+            count[0]=((tz+1) << shift > data->nz) ? data->nz - (tz << shift) : edge;
+            count[1]=((ty+1) << shift > data->ny) ? data->ny - (ty << shift) : edge;
+            count[2]=data->nx;
+
+            memset(row, 0, row_nodes * SJQBN_DISK_RECORD);
+            for(int p=0; p<SJQBN_PROP_CNT && rc == SUCCESS; p++) {
+                if(cache_tile_float(data->ncid, varids[p], start, count, slab) != NC_NOERR) {
+                    rc=FAIL;
+                    break;
+                }
+                size_t n=0;
+                for(size_t z=0; z<count[0]; z++) {
+                    for(size_t y=0; y<count[1]; y++) {
+                        for(size_t x=0; x<count[2]; x++) {
+                            size_t node=(x >> shift) * tile_nodes + ((z << (2*shift)) | (y << shift) | (x & (edge-1)));
+                            row[node*SJQBN_PROP_CNT+p]=slab[n++];
+                        }
+                    }
+                }
+            }
+            if(rc == SUCCESS) {
+                off_t at=hdr.sec_offset[SJQBN_SEC_RECORDS] + ((off_t)tz * data->nby + ty) * row_nodes * SJQBN_DISK_RECORD;
+                rc=_pwrite_all(fd, row, row_nodes * SJQBN_DISK_RECORD, at);
+            }
+        }
+    }
+    free(row);
+    free(slab);
+    close(fd);
+
+    if(rc != SUCCESS || rename(tmppath, path) != 0) {
+        unlink(tmppath);
+        fprintf(stderr, "sjqbn: failed writing tiled image %s\n", path);
+        return FAIL;
+    }
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," wrote tiled image %s (%zu bytes)\n", path, end);
+    return SUCCESS;
+}
+
+static int _read_block(sjqbn_disk_t *disk, sjqbn_disk_ctx_t *ctx, int s) {
+    char *dst=ctx->buf + (size_t)s * SJQBN_DISK_BLOCK;
+    off_t at=ctx->block[s] * SJQBN_DISK_BLOCK;
+    size_t done=0;
+
+    while(done < SJQBN_DISK_BLOCK) {
+        ssize_t n=pread(disk->fd, dst + done, SJQBN_DISK_BLOCK - done, at + done);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return FAIL;
+        done+=n;
+    }
+    return SUCCESS;
+}
+
+/* slot s is in, hand out the records it completes: those starting in
+   it or running into it from the slot before, once both halves are in */
+static void _land(sjqbn_disk_ctx_t *ctx, int s) {
+    ctx->got[s]=1;
+    for(int k=ctx->first[(s > 0) ? s-1 : 0]; k<ctx->first[s+1]; k++) {
+        sjqbn_disk_want_t *w=&ctx->want[k];
+        int s0=w->pos / SJQBN_DISK_BLOCK;
+        int s1=(w->pos + SJQBN_DISK_RECORD-1) / SJQBN_DISK_BLOCK;
+        if((s0 != s && s1 != s) || !ctx->got[s0] || !ctx->got[s1]) continue;
+
+        int rc=(ctx->res[s0] == SUCCESS && ctx->res[s1] == SUCCESS) ? SUCCESS : FAIL;
+        if(rc == SUCCESS) memcpy(ctx->out + (size_t)w->idx * SJQBN_PROP_CNT, ctx->buf + w->pos, SJQBN_DISK_RECORD);
+        ctx->rc[w->idx]=rc;
+        if(ctx->ready != NULL) ctx->ready(ctx->arg, w->idx);
+    }
+}
+
+/**** io_uring ****/
+static int _uring_setup(sjqbn_disk_ctx_t *ctx) {
+#ifdef __NR_io_uring_setup
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    ctx->ring=syscall(__NR_io_uring_setup, SJQBN_DISK_QUEUE, &p);
+    if(ctx->ring < 0) return FAIL;
+
+    ctx->sq_map_len=p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ctx->cq_map_len=p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ctx->cq_map_len > ctx->sq_map_len) ctx->sq_map_len=ctx->cq_map_len;
+        ctx->cq_map_len=0;
+    }
+    ctx->sq_map=mmap(NULL, ctx->sq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ctx->ring, IORING_OFF_SQ_RING);
+    if(ctx->sq_map == MAP_FAILED) {
+        ctx->sq_map=NULL;
+        return FAIL;
+    }
+    ctx->cq_map=ctx->sq_map;
+    if(ctx->cq_map_len > 0) {
+        ctx->cq_map=mmap(NULL, ctx->cq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ctx->ring, IORING_OFF_CQ_RING);
+        if(ctx->cq_map == MAP_FAILED) {
+            ctx->cq_map=NULL;
+            return FAIL;
+        }
+    }
+    ctx->sqes_len=p.sq_entries * sizeof(struct io_uring_sqe);
+    ctx->sqes=mmap(NULL, ctx->sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ctx->ring, IORING_OFF_SQES);
+    if(ctx->sqes == MAP_FAILED) {
+        ctx->sqes=NULL;
+        return FAIL;
+    }
+
+    char *sq=ctx->sq_map;
+    char *cq=ctx->cq_map;
+    ctx->sq_tail=(unsigned *)(sq + p.sq_off.tail);
+    ctx->sq_mask=(unsigned *)(sq + p.sq_off.ring_mask);
+    ctx->sq_array=(unsigned *)(sq + p.sq_off.array);
+    ctx->cq_head=(unsigned *)(cq + p.cq_off.head);
+    ctx->cq_tail=(unsigned *)(cq + p.cq_off.tail);
+    ctx->cq_mask=(unsigned *)(cq + p.cq_off.ring_mask);
+    ctx->cqes=(struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return SUCCESS;
+#else
+    return FAIL;
+#endif
+}
+
+static void _uring_teardown(sjqbn_disk_ctx_t *ctx) {
+    if(ctx->sqes != NULL) munmap(ctx->sqes, ctx->sqes_len);
+    if(ctx->cq_map != NULL && ctx->cq_map != ctx->sq_map) munmap(ctx->cq_map, ctx->cq_map_len);
+    if(ctx->sq_map != NULL) munmap(ctx->sq_map, ctx->sq_map_len);
+    if(ctx->ring >= 0) close(ctx->ring);
+    ctx->ring=-1;
+}
+
+static int _uring_enter(int ring, unsigned submit, unsigned wait) {
+    int n;
+    do {
+        n=syscall(__NR_io_uring_enter, ring, submit, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while(n < 0 && errno == EINTR);
+    return n;
+}
+
+/* read the round's blocks, all submitted at once, each handed out as
+   its completion is reaped */
+static void _uring_round(sjqbn_disk_t *disk, sjqbn_disk_ctx_t *ctx) {
+    unsigned tail=*ctx->sq_tail;
+    unsigned mask=*ctx->sq_mask;
+
+    for(int s=0; s<ctx->cnt; s++) {
+        unsigned i=tail & mask;
+        struct io_uring_sqe *sqe=&ctx->sqes[i];
+        memset(sqe, 0, sizeof(*sqe));
+        ctx->iov[s].iov_base=ctx->buf + (size_t)s * SJQBN_DISK_BLOCK;
+        ctx->iov[s].iov_len=SJQBN_DISK_BLOCK;
+        sqe->opcode=IORING_OP_READV;
+        sqe->fd=disk->fd;
+        sqe->off=ctx->block[s] * SJQBN_DISK_BLOCK;
+        sqe->addr=(uint64_t)(uintptr_t)&ctx->iov[s];
+        sqe->len=1;
+        sqe->user_data=s;
+        ctx->sq_array[i]=i;
+        ctx->res[s]=FAIL;
+        tail++;
+    }
+    __atomic_store_n(ctx->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int got=0;
+    int rc=_uring_enter(ctx->ring, ctx->cnt, 1);
+    while(rc >= 0 && got < ctx->cnt) {
+        unsigned head=*ctx->cq_head;
+        unsigned ready=__atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != ready; head++, got++) {
+            struct io_uring_cqe *cqe=&ctx->cqes[head & *ctx->cq_mask];
+            int s=(int)cqe->user_data;
+            if(cqe->res == SJQBN_DISK_BLOCK) ctx->res[s]=SUCCESS;
+            __atomic_store_n(ctx->cq_head, head+1, __ATOMIC_RELEASE);
+            _land(ctx, s);
+        }
+        if(got < ctx->cnt) rc=_uring_enter(ctx->ring, 0, 1);
+    }
+    if(rc < 0) {
+        // the ring is in an unknown state, this context reads with pread from now on
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," io_uring failed (%s), falling back to pread\n", strerror(errno));
+        _uring_teardown(ctx);
+        for(int s=0; s<ctx->cnt; s++) {
+            if(ctx->got[s]) continue;
+            ctx->res[s]=_read_block(disk, ctx, s);
+            _land(ctx, s);
+        }
+    }
+}
+
+/**** pread pool ****/
+/* claim the next block of ctx and read it, lock held on entry and exit */
+static void _pool_read(sjqbn_disk_t *disk, sjqbn_disk_ctx_t *ctx) {
+    int s=ctx->claimed++;
+
+    if(ctx->claimed == ctx->cnt) {
+        sjqbn_disk_ctx_t **at=&disk->work;
+        while(*at != ctx) at=&(*at)->next;
+        *at=ctx->next;
+    }
+    pthread_mutex_unlock(&disk->lock);
+    int rc=_read_block(disk, ctx, s);
+    pthread_mutex_lock(&disk->lock);
+    ctx->res[s]=rc;
+    ctx->order[ctx->done++]=s;
+    pthread_cond_broadcast(&disk->done_cond);
+}
+
+static void *_pool_worker(void *arg) {
+    sjqbn_disk_t *disk=(sjqbn_disk_t *)arg;
+
+    pthread_mutex_lock(&disk->lock);
+    for(;;) {
+        while(!disk->stop && disk->work == NULL) pthread_cond_wait(&disk->work_cond, &disk->lock);
+        if(disk->stop) break;
+        _pool_read(disk, disk->work);
+    }
+    pthread_mutex_unlock(&disk->lock);
+    return NULL;
+}
+
+/* hand the round to the pool and read along, alone when there is no
+   pool, handing out the blocks as they are read */
+static void _pool_round(sjqbn_disk_t *disk, sjqbn_disk_ctx_t *ctx) {
+    int seen=0;
+
+    pthread_mutex_lock(&disk->lock);
+    ctx->claimed=0;
+    ctx->done=0;
+    ctx->next=NULL;
+    sjqbn_disk_ctx_t **at=&disk->work;
+    while(*at != NULL) at=&(*at)->next;
+    *at=ctx;
+    pthread_cond_broadcast(&disk->work_cond);
+
+    while(seen < ctx->cnt) {
+        if(seen < ctx->done) {
+            // order[] below done is not touched again this round
+            int upto=ctx->done;
+            pthread_mutex_unlock(&disk->lock);
+            for(; seen<upto; seen++) _land(ctx, ctx->order[seen]);
+            pthread_mutex_lock(&disk->lock);
+            } else if(ctx->claimed < ctx->cnt) {
+                _pool_read(disk, ctx);
+            } else {
+                pthread_cond_wait(&disk->done_cond, &disk->lock);
+        }
+    }
+    pthread_mutex_unlock(&disk->lock);
+}
+
+/**** contexts ****/
+static void _free_ctx(sjqbn_disk_ctx_t *ctx) {
+    if(ctx == NULL) return;
+    _uring_teardown(ctx);
+    free(ctx->buf);
+    free(ctx->want);
+    free(ctx);
+}
+
+static sjqbn_disk_ctx_t *_make_ctx(sjqbn_disk_t *disk) {
+    sjqbn_disk_ctx_t *ctx=(sjqbn_disk_ctx_t *)calloc(1, sizeof(sjqbn_disk_ctx_t));
+    if(ctx == NULL) return NULL;
+    ctx->ring=-1;
+    if(posix_memalign((void **)&ctx->buf, SJQBN_DISK_BLOCK, (size_t)SJQBN_DISK_QUEUE * SJQBN_DISK_BLOCK) != 0) {
+        ctx->buf=NULL;
+        _free_ctx(ctx);
+        return NULL;
+    }
+    if(disk->engine == SJQBN_IO_URING && _uring_setup(ctx) != SUCCESS) {
+        _free_ctx(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static sjqbn_disk_ctx_t *_take_ctx(sjqbn_disk_t *disk) {
+    pthread_mutex_lock(&disk->lock);
+    sjqbn_disk_ctx_t *ctx=disk->idle;
+    if(ctx != NULL) disk->idle=ctx->next;
+    pthread_mutex_unlock(&disk->lock);
+    return (ctx != NULL) ? ctx : _make_ctx(disk);
+}
+
+static void _give_ctx(sjqbn_disk_t *disk, sjqbn_disk_ctx_t *ctx) {
+    pthread_mutex_lock(&disk->lock);
+    ctx->next=disk->idle;
+    disk->idle=ctx;
+    pthread_mutex_unlock(&disk->lock);
+}
+
+/**** open/close ****/
+/**
+ * Opens the tiled image of a dataset set up in brick layout.
+ *
+ * @param engine SJQBN_IO_AUTO/URING/PREAD, pread when io_uring is not there
+ * @param threads pread pool size, 0 for SJQBN_DISK_THREADS
+ * @return NULL if the image is missing or stale
+ */
+sjqbn_disk_t *sjqbn_disk_open(sjqbn_dataset_t *data, const char *path, const char *srcpath, int engine, int threads) {
+    struct stat src_st;
+    sjqbn_cache_header_t hdr, want;
+
+    int fd=open(path, O_RDONLY);
+    if(fd < 0) return NULL;
+    if(stat(srcpath, &src_st) != 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        close(fd);
+        return NULL;
+    }
+    _disk_header(data, &src_st, &want);
+    if(memcmp(&hdr, &want, sizeof(hdr)) != 0) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," tiled image %s is stale\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    sjqbn_disk_t *disk=(sjqbn_disk_t *)calloc(1, sizeof(sjqbn_disk_t));
+    if(disk == NULL) {
+        close(fd);
+        return NULL;
+    }
+    disk->fd=fd;
+    disk->records=hdr.sec_offset[SJQBN_SEC_RECORDS];
+    pthread_mutex_init(&disk->lock, NULL);
+    pthread_cond_init(&disk->work_cond, NULL);
+    pthread_cond_init(&disk->done_cond, NULL);
+
+    // the first context tells whether io_uring works here
+    disk->engine=SJQBN_IO_PREAD;
+    if(engine != SJQBN_IO_PREAD) {
+        disk->engine=SJQBN_IO_URING;
+        disk->idle=_make_ctx(disk);
+        if(disk->idle == NULL) {
+            if(engine == SJQBN_IO_URING) fprintf(stderr, "sjqbn: no io_uring (%s), reading with pread\n", strerror(errno));
+            disk->engine=SJQBN_IO_PREAD;
+        }
+    }
+    if(disk->engine == SJQBN_IO_PREAD) {
+        if(threads <= 0) threads=SJQBN_DISK_THREADS;
+        if(threads > SJQBN_DISK_THREADS_MAX) threads=SJQBN_DISK_THREADS_MAX;
+        disk->threads=(pthread_t *)malloc(threads * sizeof(pthread_t));
+        for(int i=0; disk->threads != NULL && i<threads; i++) {
+            if(pthread_create(&disk->threads[i], NULL, _pool_worker, disk) != 0) break;
+            disk->thread_cnt++;
+        }
+    }
+    if(sjqbn_ucvm_debug) {
+        fprintf(stderrfp," tiled image %s, %s reads", path, disk->engine == SJQBN_IO_URING ? "io_uring" : "pread");
+        if(disk->engine == SJQBN_IO_PREAD) fprintf(stderrfp," on %d threads", disk->thread_cnt);
+        fprintf(stderrfp,"\n");
+    }
+    return disk;
+}
+
+void sjqbn_disk_close(sjqbn_disk_t *disk) {
+    if(disk == NULL) return;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," tiled image: %ld batches, %ld block reads\n", disk->batches, disk->reads);
+
+    pthread_mutex_lock(&disk->lock);
+    disk->stop=1;
+    pthread_cond_broadcast(&disk->work_cond);
+    pthread_mutex_unlock(&disk->lock);
+    for(int i=0; i<disk->thread_cnt; i++) pthread_join(disk->threads[i], NULL);
+    free(disk->threads);
+
+    while(disk->idle != NULL) {
+        sjqbn_disk_ctx_t *ctx=disk->idle;
+        disk->idle=ctx->next;
+        _free_ctx(ctx);
+    }
+    pthread_cond_destroy(&disk->work_cond);
+    pthread_cond_destroy(&disk->done_cond);
+    pthread_mutex_destroy(&disk->lock);
+    close(disk->fd);
+    free(disk);
+}
+
+/**** queries ****/
+static int _by_offset(const void *a, const void *b) {
+    size_t x=((const sjqbn_disk_want_t *)a)->offset;
+    size_t y=((const sjqbn_disk_want_t *)b)->offset;
+    return (x > y) - (x < y);
+}
+
+/* buffer slot of block b among the round's last two, -1 if not there */
+static inline int _held(sjqbn_disk_ctx_t *ctx, off_t b) {
+    if(ctx->cnt > 0 && ctx->block[ctx->cnt-1] == b) return ctx->cnt-1;
+    if(ctx->cnt > 1 && ctx->block[ctx->cnt-2] == b) return ctx->cnt-2;
+    return -1;
+}
+
+/**
+ * Copies vp/vs/rho of n nodes at brick layout offsets, out holds n
+ * records and rc the outcome of each. Their blocks are read together,
+ * in rounds of at most SJQBN_DISK_QUEUE, and each record is copied as
+ * soon as its blocks are in.
+ *
+ * @param ready if not NULL called with the node's index into offsets
+ * once its record and rc are set, while the rest are still being read
+ */
+void sjqbn_disk_values_n(sjqbn_disk_t *disk, size_t *offsets, int n, float *out, int *rc,
+          sjqbn_disk_ready_fn ready, void *arg) {
+    sjqbn_disk_ctx_t *ctx=_take_ctx(disk);
+
+    if(ctx != NULL && ctx->want_cap < n) {
+        free(ctx->want);
+        ctx->want=(sjqbn_disk_want_t *)malloc(n * sizeof(sjqbn_disk_want_t));
+        ctx->want_cap=(ctx->want != NULL) ? n : 0;
+    }
+    if(ctx == NULL || ctx->want == NULL) {
+        for(int i=0; i<n; i++) rc[i]=FAIL;
+        if(ctx != NULL) _give_ctx(disk, ctx);
+        return;
+    }
+
+    sjqbn_disk_want_t *want=ctx->want;
+    for(int i=0; i<n; i++) {
+        want[i].offset=offsets[i];
+        want[i].idx=i;
+    }
+    qsort(want, n, sizeof(sjqbn_disk_want_t), _by_offset);
+    ctx->out=out;
+    ctx->rc=rc;
+    ctx->ready=ready;
+    ctx->arg=arg;
+
+    long reads=0;
+    int j=0;
+    while(j < n) {
+        int j0=j;
+
+        // blocks come in ascending order, a record spans at most two
+        ctx->cnt=0;
+        for(; j<n; j++) {
+            off_t byte=disk->records + (off_t)want[j].offset * SJQBN_DISK_RECORD;
+            off_t b0=byte / SJQBN_DISK_BLOCK;
+            off_t b1=(byte + SJQBN_DISK_RECORD-1) / SJQBN_DISK_BLOCK;
+            int s0=_held(ctx, b0);
+            int need=(s0 < 0) + (b1 != b0 && _held(ctx, b1) < 0);
+            if(ctx->cnt + need > SJQBN_DISK_QUEUE) break;
+            if(s0 < 0) {
+                s0=ctx->cnt;
+                ctx->block[ctx->cnt++]=b0;
+            }
+            if(b1 != b0 && _held(ctx, b1) < 0) ctx->block[ctx->cnt++]=b1;
+            want[j].pos=s0 * SJQBN_DISK_BLOCK + (int)(byte % SJQBN_DISK_BLOCK);
+        }
+        for(int s=0, k=j0; s<=ctx->cnt; s++) {
+            while(k < j && want[k].pos / SJQBN_DISK_BLOCK < s) k++;
+            ctx->first[s]=k;
+        }
+        memset(ctx->got, 0, ctx->cnt);
+
+        if(ctx->ring >= 0) {
+            _uring_round(disk, ctx);
+            } else {
+                _pool_round(disk, ctx);
+        }
+        reads+=ctx->cnt;
+    }
+
+    __atomic_add_fetch(&disk->batches, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&disk->reads, reads, __ATOMIC_RELAXED);
+    _give_ctx(disk, ctx);
+}
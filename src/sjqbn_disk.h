@@ -0,0 +1,64 @@
+/**
+ * @file sjqbn_disk.h
+ *
+ * disk resident access without a tile cache: the nodes a query batch
+ * needs are read from a tiled image of the model in one submission,
+ * through io_uring or a pread thread pool
+ *
+**/
+
+#ifndef SJQBN_DISK_H
+#define SJQBN_DISK_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "sjqbn_util.h"
+
+/* tiled image next to the netCDF file, a cache image (sjqbn_cache.h)
+   in brick layout with interleaved float records */
+#define SJQBN_DISK_SUFFIX ".tiles"
+/* unit of a read, the records of a cell corner sit in one or two */
+#define SJQBN_DISK_BLOCK 4096
+/* blocks in flight per batch */
+#define SJQBN_DISK_QUEUE 128
+#define SJQBN_DISK_THREADS 8
+#define SJQBN_DISK_THREADS_MAX 64
+
+/* how the reads are issued */
+#define SJQBN_IO_AUTO 0   /* io_uring when the kernel has it, else pread */
+#define SJQBN_IO_URING 1
+#define SJQBN_IO_PREAD 2
+
+struct sjqbn_disk_ctx_t;
+
+/* told of each node of a batch as soon as it is read, idx into offsets */
+typedef void (*sjqbn_disk_ready_fn)(void *arg, int idx);
+
+typedef struct sjqbn_disk_t {
+        int fd;
+        off_t records;       /* byte offset of the records section */
+        int engine;          /* SJQBN_IO_URING or SJQBN_IO_PREAD */
+
+        /* contexts of finished batches, reused by the next ones */
+        struct sjqbn_disk_ctx_t *idle;
+        /* pread pool, batches with blocks left to read */
+        int thread_cnt;
+        pthread_t *threads;
+        struct sjqbn_disk_ctx_t *work;
+        int stop;
+        pthread_mutex_t lock;
+        pthread_cond_t work_cond;
+        pthread_cond_t done_cond;
+
+        long batches;
+        long reads;
+} sjqbn_disk_t;
+
+int sjqbn_disk_write(sjqbn_dataset_t *data, const char *path, const char *srcpath);
+sjqbn_disk_t *sjqbn_disk_open(sjqbn_dataset_t *data, const char *path, const char *srcpath, int engine, int threads);
+void sjqbn_disk_close(sjqbn_disk_t *disk);
+void sjqbn_disk_values_n(sjqbn_disk_t *disk, size_t *offsets, int n, float *out, int *rc,
+          sjqbn_disk_ready_fn ready, void *arg);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+         sjqbn_numa.c
+
+   Topology comes from sysfs and placement is done with the mbind and
+   getcpu system calls directly, so there is no libnuma dependency.
+   Binding only decides where pages go at first touch, so it has to
+   happen right after a volume is mapped and before it is filled.
+**/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+#include "sjqbn.h"
+#include "sjqbn_numa.h"
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+static int numa_node_cnt=0;
+
+/* number of NUMA nodes, from the highest id in the online list */
+int sjqbn_numa_nodes(void) {
+    char line[256];
+
+    if(numa_node_cnt > 0) return numa_node_cnt;
+    numa_node_cnt=1;
+
+    FILE *fp=fopen("/sys/devices/system/node/online", "r");
+    if(fp == NULL) return numa_node_cnt;
+    if(fgets(line, sizeof(line), fp) != NULL) { // e.g. 0-1 or 0,2-3
+        int last=0;
+        for(char *tok=strtok(line, ",\n"); tok != NULL; tok=strtok(NULL, ",\n")) {
+            char *dash=strchr(tok, '-');
+            int id=atoi(dash ? dash+1 : tok);
+            if(id > last) last=id;
+        }
+        numa_node_cnt=(last+1 > SJQBN_NUMA_MAX) ? SJQBN_NUMA_MAX : last+1;
+    }
+    fclose(fp);
+    return numa_node_cnt;
+}
+
+/* node of the cpu the calling thread is running on */
+int sjqbn_numa_current_node(void) {
+#ifdef SYS_getcpu
+    unsigned cpu=0, node=0;
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < SJQBN_NUMA_MAX) return node;
+#endif
+    return 0;
+}
+
+/**
+ * Sets the placement of a freshly mapped range.
+ *
+ * @param policy SJQBN_NUMA_INTERLEAVE spreads over all nodes, any other
+ *   policy binds to node when node >= 0
+ * @return SUCCESS or FAIL
+ */
+int sjqbn_numa_bind(void *ptr, size_t len, int policy, int node) {
+#ifdef SYS_mbind
+    unsigned long mask=0;
+    int mode;
+
+    if(policy == SJQBN_NUMA_INTERLEAVE) {
+        mode=MPOL_INTERLEAVE;
+        mask=(1UL << sjqbn_numa_nodes()) - 1;
+        } else if(node >= 0) {
+            mode=MPOL_BIND;
+            mask=1UL << node;
+        } else {
+            return SUCCESS;
+    }
+    if(syscall(SYS_mbind, ptr, len, mode, &mask, sizeof(mask)*8, 0) != 0) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," mbind mode %d mask %lx failed (%s)\n", mode, mask, strerror(errno));
+        return FAIL;
+    }
+    return SUCCESS;
+#else
+    return FAIL;
+#endif
+}
@@ -0,0 +1,24 @@
+/**
+ * @file sjqbn_numa.h
+ *
+ * NUMA topology and placement of the property volumes
+ *
+**/
+
+#ifndef SJQBN_NUMA_H
+#define SJQBN_NUMA_H
+
+#include <stddef.h>
+
+#define SJQBN_NUMA_MAX 8
+
+/* placement of the property volumes across NUMA nodes */
+#define SJQBN_NUMA_OFF 0
+#define SJQBN_NUMA_INTERLEAVE 1  /* pages spread round robin over all nodes */
+#define SJQBN_NUMA_REPLICATE 2   /* one copy per node, read by local threads */
+
+int sjqbn_numa_nodes(void);
+int sjqbn_numa_current_node(void);
+int sjqbn_numa_bind(void *ptr, size_t len, int policy, int node);
+
+#endif
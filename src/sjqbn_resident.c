@@ -0,0 +1,79 @@
+/**
+         sjqbn_resident.c
+
+   A query on a mapped image stalls on the first touch of every page
+   that is not in memory yet, one at a time. Advising the pages of a
+   whole batch up front lets the kernel read them in parallel, and
+   locking a hot region keeps it from being evicted at all. The page
+   fault counters of the calling thread show what either one buys.
+**/
+
+#define _GNU_SOURCE  /* RUSAGE_THREAD */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "sjqbn.h"
+#include "sjqbn_util.h"
+#include "sjqbn_resident.h"
+
+static int _by_address(const void *a, const void *b) {
+    uintptr_t x=*(const uintptr_t *)a;
+    uintptr_t y=*(const uintptr_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Asks the kernel to read in n pages, given by their page aligned
+ * address in any order and with repeats. Runs of adjacent pages go in
+ * one madvise. The array is sorted in place.
+ */
+void sjqbn_resident_advise(uintptr_t *pages, int n) {
+    if(n <= 0) return;
+    qsort(pages, n, sizeof(uintptr_t), _by_address);
+
+    uintptr_t start=pages[0];
+    uintptr_t end=start + SJQBN_SMALL_PAGE;
+    for(int i=1; i<=n; i++) {
+        if(i < n && pages[i] <= end) {
+            if(pages[i] == end) end+=SJQBN_SMALL_PAGE;
+            continue;
+        }
+        madvise((void *)start, end - start, MADV_WILLNEED);
+        if(i < n) {
+            start=pages[i];
+            end=start + SJQBN_SMALL_PAGE;
+        }
+    }
+}
+
+/**
+ * Locks the pages holding [ptr, ptr+len) in memory, reading them in.
+ *
+ * @return bytes locked, 0 if mlock failed, usually RLIMIT_MEMLOCK
+ */
+size_t sjqbn_resident_pin(void *ptr, size_t len) {
+    uintptr_t start=(uintptr_t)ptr & ~((uintptr_t)SJQBN_SMALL_PAGE-1);
+    uintptr_t end=((uintptr_t)ptr + len + SJQBN_SMALL_PAGE-1) & ~((uintptr_t)SJQBN_SMALL_PAGE-1);
+
+    if(len == 0) return 0;
+    if(mlock((void *)start, end - start) != 0) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," mlock of %zu bytes failed (%s)\n", (size_t)(end - start), strerror(errno));
+        return 0;
+    }
+    return end - start;
+}
+
+/* page faults of the calling thread so far */
+void sjqbn_resident_faults(long *major, long *minor) {
+    struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+    if(getrusage(RUSAGE_THREAD, &ru) != 0)
+#endif
+    getrusage(RUSAGE_SELF, &ru);
+    *major=ru.ru_majflt;
+    *minor=ru.ru_minflt;
+}
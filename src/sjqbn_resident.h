@@ -0,0 +1,19 @@
+/**
+ * @file sjqbn_resident.h
+ *
+ * residency of the dense storage: read ahead of the pages a query batch
+ * touches, pinning of a hot region and page fault counts
+ *
+**/
+
+#ifndef SJQBN_RESIDENT_H
+#define SJQBN_RESIDENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void sjqbn_resident_advise(uintptr_t *pages, int n);
+size_t sjqbn_resident_pin(void *ptr, size_t len);
+void sjqbn_resident_faults(long *major, long *minor);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+         sjqbn_rle.c
+
+   Compressed storage for models whose deep columns are constant or
+   piecewise constant. Each lat/lon column is kept as runs of equal
+   vp/vs/rho records down depth; col_start gives a column's first run
+   directly and a short search within it the run holding a depth.
+**/
+
+#include "ucvm_model_dtypes.h"
+#include "sjqbn.h"
+#include "sjqbn_rle.h"
+
+/* bitwise, so NaN nodes still form runs */
+static inline int _same_node(float **volumes, size_t a, size_t b) {
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        if(memcmp(&volumes[p][a], &volumes[p][b], sizeof(float)) != 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Encodes slab layout float volumes, depth, lat, lon as in the netCDF
+ * file. Both passes walk the volumes in memory order, comparing each
+ * slab with the one above it.
+ *
+ * @param volumes vp, vs and rho
+ * @return the encoded columns, NULL if they can not be indexed or
+ *         memory runs out
+ */
+sjqbn_rle_t *make_sjqbn_rle(float **volumes, int nx, int ny, int nz) {
+    size_t cols=(size_t)nx * ny;
+    uint32_t *cursor;
+
+    if(nz > UINT16_MAX) {
+        fprintf(stderr, "rle: %d depths do not fit the run index\n", nz);
+        return NULL;
+    }
+    sjqbn_rle_t *rle=(sjqbn_rle_t *)calloc(1, sizeof(sjqbn_rle_t));
+    if(rle == NULL) return NULL;
+    rle->nx=nx;
+    rle->ny=ny;
+    rle->nz=nz;
+
+    // runs per column
+    rle->col_start=(uint32_t *)calloc(cols+1, sizeof(uint32_t));
+    cursor=(uint32_t *)malloc(cols * sizeof(uint32_t));
+    if(rle->col_start == NULL || cursor == NULL) {
+        fprintf(stderr, "rle: malloc failed\n");
+        free(cursor);
+        free_sjqbn_rle(rle);
+        return NULL;
+    }
+    size_t runs=cols;
+    for(int z=1; z<nz; z++) {
+        size_t layer=(size_t)z * cols;
+        for(size_t c=0; c<cols; c++) {
+            if(!_same_node(volumes, layer+c, layer-cols+c)) {
+                rle->col_start[c+1]++;
+                runs++;
+            }
+        }
+    }
+    if(runs > UINT32_MAX) {
+        fprintf(stderr, "rle: %zu runs do not fit the column index\n", runs);
+        free(cursor);
+        free_sjqbn_rle(rle);
+        return NULL;
+    }
+    for(size_t c=0; c<cols; c++) {
+        rle->col_start[c+1]+=rle->col_start[c] + 1;
+        cursor[c]=rle->col_start[c];
+    }
+
+    rle->run_cnt=runs;
+    rle->run_z=(uint16_t *)malloc(runs * sizeof(uint16_t));
+    rle->run_val=(float *)malloc(runs * SJQBN_PROP_CNT * sizeof(float));
+    if(rle->run_z == NULL || rle->run_val == NULL) {
+        fprintf(stderr, "rle: malloc failed\n");
+        free(cursor);
+        free_sjqbn_rle(rle);
+        return NULL;
+    }
+
+    // fill, every column opens a run at depth 0
+    for(int z=0; z<nz; z++) {
+        size_t layer=(size_t)z * cols;
+        for(size_t c=0; c<cols; c++) {
+            if(z > 0 && _same_node(volumes, layer+c, layer-cols+c)) continue;
+            uint32_t r=cursor[c]++;
+            rle->run_z[r]=z;
+            for(int p=0; p<SJQBN_PROP_CNT; p++) {
+                rle->run_val[(size_t)r*SJQBN_PROP_CNT+p]=volumes[p][layer+c];
+            }
+        }
+    }
+    free(cursor);
+    return rle;
+}
+
+void free_sjqbn_rle(sjqbn_rle_t *rle) {
+    if(rle == NULL) return;
+    free(rle->col_start);
+    free(rle->run_z);
+    free(rle->run_val);
+    free(rle);
+}
+
+/* memory the encoded columns take */
+size_t sjqbn_rle_bytes(sjqbn_rle_t *rle) {
+    return ((size_t)rle->nx * rle->ny + 1) * sizeof(uint32_t) +
+           rle->run_cnt * (sizeof(uint16_t) + SJQBN_PROP_CNT * sizeof(float));
+}
@@ -0,0 +1,54 @@
+/**
+ * @file sjqbn_rle.h
+ *
+ * run-length encoded depth columns: each lat/lon column is a list of
+ * runs of equal vp/vs/rho down depth
+ *
+**/
+
+#ifndef SJQBN_RLE_H
+#define SJQBN_RLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct sjqbn_rle_t {
+        int nx;
+        int ny;
+        int nz;
+
+        /* runs of column y*nx+x are col_start[c] .. col_start[c+1]-1 */
+        uint32_t *col_start;  /* [nx*ny+1] */
+        size_t run_cnt;
+        uint16_t *run_z;      /* first depth index of each run */
+        float *run_val;       /* vp/vs/rho record of each run */
+} sjqbn_rle_t;
+
+sjqbn_rle_t *make_sjqbn_rle(float **volumes, int nx, int ny, int nz);
+void free_sjqbn_rle(sjqbn_rle_t *rle);
+size_t sjqbn_rle_bytes(sjqbn_rle_t *rle);
+
+/* run of column col holding depth index z */
+static inline uint32_t sjqbn_rle_run(sjqbn_rle_t *rle, size_t col, int z) {
+    uint32_t lo=rle->col_start[col];
+    uint32_t hi=rle->col_start[col+1];
+
+    // last run starting at or before z, the first one starts at 0
+    while(hi - lo > 1) {
+        uint32_t mid=lo + ((hi - lo) >> 1);
+        if(rle->run_z[mid] <= z) {
+            lo=mid;
+            } else {
+                hi=mid;
+        }
+    }
+    return lo;
+}
+
+/* run of the same column holding z+1, given run r holding z */
+static inline uint32_t sjqbn_rle_next(sjqbn_rle_t *rle, size_t col, uint32_t r, int z) {
+    if(r+1 < rle->col_start[col+1] && rle->run_z[r+1] <= z+1) return r+1;
+    return r;
+}
+
+#endif
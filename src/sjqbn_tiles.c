@@ -0,0 +1,193 @@
+/**
+         sjqbn_tiles.c
+
+   Disk resident mode. The dataset keeps the brick layout's offsets
+   but no volumes; a node's offset names its tile (the brick) and its
+   place inside it. Tiles are read on first use, one hyperslab per
+   property, into a fixed number of slots sized from the memory
+   budget, and the least recently used tile is evicted.
+**/
+
+#include "ucvm_model_dtypes.h"
+#include "sjqbn.h"
+#include "um_netcdf.h"
+#include "sjqbn_tiles.h"
+
+/**
+ * Sets up an empty cache over an open netCDF file.
+ *
+ * @param origin file index of the grid's first node, x/y/z
+ * @param budget bytes the slots may take
+ * @return the cache or NULL
+ */
+sjqbn_tile_cache_t *make_sjqbn_tile_cache(int ncid, int *varids, int *origin, int nx, int ny, int nz, int shift, size_t budget) {
+    sjqbn_tile_cache_t *cache=(sjqbn_tile_cache_t *)calloc(1, sizeof(sjqbn_tile_cache_t));
+    if(cache == NULL) return NULL;
+
+    int edge=1 << shift;
+    cache->ncid=ncid;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) cache->varids[p]=varids[p];
+    for(int a=0; a<3; a++) cache->origin[a]=origin[a];
+    cache->nx=nx;
+    cache->ny=ny;
+    cache->nz=nz;
+    cache->shift=shift;
+    cache->ntx=(nx + edge-1) >> shift;
+    cache->nty=(ny + edge-1) >> shift;
+    cache->ntz=(nz + edge-1) >> shift;
+    cache->tile_nodes=(size_t)edge * edge * edge;
+
+    size_t tile_bytes=cache->tile_nodes * SJQBN_PROP_CNT * sizeof(float);
+    size_t ntiles=(size_t)cache->ntx * cache->nty * cache->ntz;
+    size_t slots=budget / tile_bytes;
+    if(slots < SJQBN_TILE_MIN_SLOTS) slots=SJQBN_TILE_MIN_SLOTS;
+    if(slots > ntiles) slots=ntiles;
+    cache->slot_cnt=slots;
+
+    cache->slots=(float *)malloc(slots * tile_bytes);
+    cache->slot_tile=(int64_t *)malloc(slots * sizeof(int64_t));
+    cache->prev=(int *)malloc(slots * sizeof(int));
+    cache->next=(int *)malloc(slots * sizeof(int));
+    cache->tile_slot=(int *)malloc(ntiles * sizeof(int));
+    cache->staging=(float *)malloc(cache->tile_nodes * sizeof(float));
+    if(!cache->slots || !cache->slot_tile || !cache->prev || !cache->next || !cache->tile_slot || !cache->staging) {
+        fprintf(stderr, "tile cache: malloc failed\n");
+        free_sjqbn_tile_cache(cache);
+        return NULL;
+    }
+
+    // all slots free, chained in order
+    for(int s=0; s<cache->slot_cnt; s++) {
+        cache->slot_tile[s]=-1;
+        cache->prev[s]=s-1;
+        cache->next[s]=(s+1 < cache->slot_cnt) ? s+1 : -1;
+    }
+    cache->head=0;
+    cache->tail=cache->slot_cnt-1;
+    for(size_t t=0; t<ntiles; t++) cache->tile_slot[t]=-1;
+
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void free_sjqbn_tile_cache(sjqbn_tile_cache_t *cache) {
+    if(cache == NULL) return;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," tile cache: %ld hits %ld misses, %d slots\n", cache->hits, cache->misses, cache->slot_cnt);
+    free(cache->slots);
+    free(cache->slot_tile);
+    free(cache->prev);
+    free(cache->next);
+    free(cache->tile_slot);
+    free(cache->staging);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/* move slot s to the head of the LRU list */
+static void _touch(sjqbn_tile_cache_t *cache, int s) {
+    if(cache->head == s) return;
+
+    // unlink
+    cache->next[cache->prev[s]]=cache->next[s];
+    if(cache->next[s] >= 0) {
+        cache->prev[cache->next[s]]=cache->prev[s];
+        } else {
+            cache->tail=cache->prev[s];
+    }
+    // push front
+    cache->prev[s]=-1;
+    cache->next[s]=cache->head;
+    cache->prev[cache->head]=s;
+    cache->head=s;
+}
+
+/* read tile t into slot s, as vp/vs/rho records in brick order */
+static int _load_tile(sjqbn_tile_cache_t *cache, int64_t t, int s) {
+    int shift=cache->shift;
+    size_t edge=(size_t)1 << shift;
+    int tx=t % cache->ntx;
+    int ty=(t / cache->ntx) % cache->nty;
+    int tz=t / ((int64_t)cache->ntx * cache->nty);
+
+    size_t start[3]={ (size_t)tz << shift, (size_t)ty << shift, (size_t)tx << shift };
+    size_t count[3];
+    count[0]=(cache->nz - start[0] < edge) ? cache->nz - start[0] : edge;
+    count[1]=(cache->ny - start[1] < edge) ? cache->ny - start[1] : edge;
+    count[2]=(cache->nx - start[2] < edge) ? cache->nx - start[2] : edge;
+
+    float *rec=cache->slots + (size_t)s * cache->tile_nodes * SJQBN_PROP_CNT;
+    size_t file_start[3]={ start[0] + cache->origin[2], start[1] + cache->origin[1], start[2] + cache->origin[0] };
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        if(cache_tile_float(cache->ncid, cache->varids[p], file_start, count, cache->staging) != NC_NOERR) {
+            return FAIL;
+        }
+        size_t n=0;
+        for(size_t z=0; z<count[0]; z++) {
+            for(size_t y=0; y<count[1]; y++) {
+                for(size_t x=0; x<count[2]; x++) {
+                    size_t inner=(z << (2*shift)) | (y << shift) | x;
+                    rec[inner*SJQBN_PROP_CNT+p]=cache->staging[n++];
+                }
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+/* sjqbn_tile_values with the lock held */
+static int _tile_values(sjqbn_tile_cache_t *cache, size_t offset, float *out) {
+    int64_t t=offset >> (3*cache->shift);
+    size_t inner=offset & (cache->tile_nodes-1);
+    int rc=SUCCESS;
+
+    int s=cache->tile_slot[t];
+    if(s >= 0) {
+        cache->hits++;
+        } else {
+            cache->misses++;
+            s=cache->tail;
+            if(cache->slot_tile[s] >= 0) cache->tile_slot[cache->slot_tile[s]]=-1;
+            cache->slot_tile[s]=-1;
+            // an empty slot stays at the tail, the next one to be reused
+            if(_load_tile(cache, t, s) == SUCCESS) {
+                cache->slot_tile[s]=t;
+                cache->tile_slot[t]=s;
+                } else {
+                    rc=FAIL;
+            }
+    }
+
+    if(rc == SUCCESS) {
+        _touch(cache, s);
+        float *rec=cache->slots + ((size_t)s * cache->tile_nodes + inner) * SJQBN_PROP_CNT;
+        out[SJQBN_VP_IDX]=rec[SJQBN_VP_IDX];
+        out[SJQBN_VS_IDX]=rec[SJQBN_VS_IDX];
+        out[SJQBN_RHO_IDX]=rec[SJQBN_RHO_IDX];
+    }
+    return rc;
+}
+
+/**
+ * Copies vp/vs/rho of the node at a brick layout offset, reading its
+ * tile first if it is not cached.
+ *
+ * @return SUCCESS or FAIL
+ */
+int sjqbn_tile_values(sjqbn_tile_cache_t *cache, size_t offset, float *out) {
+    pthread_mutex_lock(&cache->lock);
+    int rc=_tile_values(cache, offset, out);
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+/**
+ * sjqbn_tile_values for n nodes under one lock, out holds n vp/vs/rho
+ * records and rc the outcome of each.
+ */
+void sjqbn_tile_values_n(sjqbn_tile_cache_t *cache, size_t *offsets, int n, float *out, int *rc) {
+    pthread_mutex_lock(&cache->lock);
+    for(int i=0; i<n; i++) {
+        rc[i]=_tile_values(cache, offsets[i], out + (size_t)i * SJQBN_PROP_CNT);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file sjqbn_tiles.h
+ *
+ * disk resident access: fixed size tiles read by netCDF hyperslab
+ * into a bounded LRU cache
+ *
+**/
+
+#ifndef SJQBN_TILES_H
+#define SJQBN_TILES_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SJQBN_TILE_SIZE 16
+#define SJQBN_TILE_CACHE_MB 256
+/* a trilinear cell can straddle 8 tiles */
+#define SJQBN_TILE_MIN_SLOTS 8
+
+typedef struct sjqbn_tile_cache_t {
+        int ncid;
+        int varids[3];       /* vp, vs, rho */
+        int origin[3];       /* file index of the grid's first node, x/y/z */
+
+        /* grid and tiling, tiles are bricks of the dataset's brick layout */
+        int nx;
+        int ny;
+        int nz;
+        int shift;           /* log2 of tile edge */
+        int ntx;
+        int nty;
+        int ntz;
+        size_t tile_nodes;
+
+        /* slots each hold one tile as vp/vs/rho records */
+        int slot_cnt;
+        float *slots;
+        int64_t *slot_tile;  /* tile held, -1 when free */
+        int *prev;           /* LRU list through the slots, head is newest */
+        int *next;
+        int head;
+        int tail;
+        int *tile_slot;      /* tile -> slot, -1 when not cached */
+        float *staging;      /* one property of one tile as read */
+
+        long hits;
+        long misses;
+        pthread_mutex_t lock;
+} sjqbn_tile_cache_t;
+
+sjqbn_tile_cache_t *make_sjqbn_tile_cache(int ncid, int *varids, int *origin, int nx, int ny, int nz, int shift, size_t budget);
+void free_sjqbn_tile_cache(sjqbn_tile_cache_t *cache);
+int sjqbn_tile_values(sjqbn_tile_cache_t *cache, size_t offset, float *out);
+void sjqbn_tile_values_n(sjqbn_tile_cache_t *cache, size_t *offsets, int n, float *out, int *rc);
+
+#endif
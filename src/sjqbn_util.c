@@ -2,22 +2,648 @@
          sjqbn_util.c
 **/
 
+#include <sys/mman.h>
+#include <float.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "ucvm_model_dtypes.h"
 #include "sjqbn.h"
 #include "um_netcdf.h"
 
 #include "sjqbn_util.h"
+#include "sjqbn_cache.h"
+#include "sjqbn_numa.h"
+#include "sjqbn_tiles.h"
+#include "sjqbn_disk.h"
+#include "sjqbn_rle.h"
+#include "sjqbn_backend.h"
+#include "sjqbn_resident.h"
+
+static size_t _layout_offset(sjqbn_dataset_t *dataset, int x_idx, int y_idx, int z_idx);
+static void _free_storage(sjqbn_dataset_t *data);
+static void _setup_residency(sjqbn_dataset_t *data, sjqbn_configuration_t *config);
+static void _setup_axes(sjqbn_dataset_t *data);
+
+/**** property volumes ****/
+/* Volumes are anonymous mappings so they can be put on 2MB pages:
+   explicit hugetlb pages when the system has them reserved, otherwise
+   transparent huge pages are requested with madvise. */
+static size_t _volume_bytes(sjqbn_dataset_t *data, size_t bytes) {
+    size_t page= data->huge_pages ? SJQBN_HUGE_PAGE : SJQBN_SMALL_PAGE;
+    return (bytes + page-1) & ~(page-1);
+}
+
+void *alloc_sjqbn_volume(sjqbn_dataset_t *data, size_t bytes) {
+    size_t len=_volume_bytes(data, bytes);
+    void *ptr=MAP_FAILED;
+    // lazy volumes are address space until slabs are filled, so are not
+    // charged against the commit limit up front
+    int reserve=data->lazy ? MAP_NORESERVE : 0;
+
+#ifdef MAP_HUGETLB
+    if(data->huge_pages) {
+        ptr=mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|reserve, -1, 0);
+        if(ptr != MAP_FAILED) data->hugetlb_volumes++;
+    }
+#endif
+    if(ptr == MAP_FAILED) {
+        ptr=mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|reserve, -1, 0);
+        if(ptr == MAP_FAILED) {
+            fprintf(stderr, "volume: mmap of %zu bytes failed\n", len);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if(data->huge_pages && madvise(ptr, len, MADV_HUGEPAGE) == 0) {
+            data->thp_volumes++;
+            } else {
+                data->small_volumes++;
+        }
+#else
+        data->small_volumes++;
+#endif
+    }
+
+    // placement sticks at first touch, so before anything is written
+    if(data->numa_policy != SJQBN_NUMA_OFF) {
+        sjqbn_numa_bind(ptr, len, data->numa_policy, data->numa_node);
+    }
+    return ptr;
+}
+
+void free_sjqbn_volume(sjqbn_dataset_t *data, void *ptr, size_t bytes) {
+    if(ptr != NULL) munmap(ptr, _volume_bytes(data, bytes));
+}
+
+/* bytes of the advised volumes the kernel actually backs with huge pages */
+static size_t _thp_backed(void) {
+    char line[256];
+    size_t total=0, kb;
+    FILE *fp=fopen("/proc/self/smaps", "r");
+    if(fp == NULL) return 0;
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        if(sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) total+=kb * 1024;
+    }
+    fclose(fp);
+    return total;
+}
+
+static void _report_pages(sjqbn_dataset_t *data) {
+    if(!data->huge_pages) return;
+    fprintf(stderr, "sjqbn: volume allocations on 2MB hugetlb pages %d, transparent huge pages %d (%zu MB huge now), 4KB pages %d\n",
+            data->hugetlb_volumes, data->thp_volumes, _thp_backed() >> 20, data->small_volumes);
+}
 
 /**** for sjqbn_dataset_t ****/
-sjqbn_dataset_t *make_a_sjqbn_dataset(char *datadir, char *datafile, int tooBig) {
-    char filepath[256];
-    size_t nelems= 0;
-    nc_type vtype;
+/* pick the node ordering and the number of nodes it needs */
+void setup_sjqbn_layout(sjqbn_dataset_t *data, int layout, int brick_size) {
+    data->layout=layout;
+    data->x_stride=1;
+    data->y_stride=data->nx;
+    data->z_stride=(size_t)data->nx * data->ny;
+    data->brick_shift=0;
+    data->nbx=0;
+    data->nby=0;
+    data->store_elems=(size_t)data->nx * data->ny * data->nz;
 
-    sjqbn_dataset_t *data=(sjqbn_dataset_t *)malloc(sizeof(sjqbn_dataset_t));
+    if(layout == SJQBN_LAYOUT_COLUMN) {
+        data->z_stride=1;
+        data->x_stride=data->nz;
+        data->y_stride=(size_t)data->nx * data->nz;
+    }
 
-    sprintf(filepath, "%s/%s", datadir, datafile);
-    if(sjqbn_ucvm_debug) fprintf(stderrfp," data file ..%s\n", filepath);
+    if(layout == SJQBN_LAYOUT_BRICK) {
+        if(brick_size <= 0) brick_size=SJQBN_BRICK_SIZE;
+        int shift=0;
+        while((1 << (shift+1)) <= brick_size) shift++;
+        int b=1 << shift;
+        int nbz=(data->nz + b-1) >> shift;
+        data->brick_shift=shift;
+        data->nbx=(data->nx + b-1) >> shift;
+        data->nby=(data->ny + b-1) >> shift;
+        data->store_elems=(size_t)data->nbx * data->nby * nbz * b*b*b;
+    }
+    data->wide_index=(data->store_elems > UINT32_MAX);
+}
+
+/* nodes of an ascending axis that cover [lo,hi], one beyond each bound
+   when there is one so edge points still interpolate; returns the
+   count and the first index, the whole axis if nothing is covered */
+static int _roi_window(float *axis, int n, float *bounds, int *first) {
+    int i0=0, i1=n-1;
+
+    while(i0+1 < n && axis[i0+1] <= bounds[0]) i0++;
+    while(i1-1 >= 0 && axis[i1-1] >= bounds[1]) i1--;
+    if(i1 < i0) {
+        fprintf(stderr, "roi: %g..%g misses the axis %g..%g, using all of it\n", bounds[0], bounds[1], axis[0], axis[n-1]);
+        i0=0;
+        i1=n-1;
+    }
+    *first=i0;
+    return i1-i0+1;
+}
+
+/* cut an axis down to its region of interest, in place */
+static int _roi_axis(float *axis, int *n, float *bounds) {
+    int first;
+
+    *n=_roi_window(axis, *n, bounds, &first);
+    memmove(axis, axis+first, *n * sizeof(float));
+    return first;
+}
+
+static int _roi_active(sjqbn_dataset_t *data) {
+    for(int a=0; a<3; a++) {
+        if(data->roi[a][0] != -FLT_MAX || data->roi[a][1] != FLT_MAX) return 1;
+    }
+    return 0;
+}
+
+/* depth slab z of one property of the region of interest */
+static int _read_roi_layer(sjqbn_dataset_t *data, int varid, int z, float *buf) {
+    if(!_roi_active(data)) {
+        return cache_latlon_layer_float(data->ncid, varid, z, data->ny, data->nx, buf);
+    }
+    size_t start[3]={ data->z0 + z, data->y0, data->x0 };
+    size_t count[3]={ 1, data->ny, data->nx };
+    return cache_tile_float(data->ncid, varid, start, count, buf);
+}
+
+/* record how the property variables are stored on disk */
+static void _inspect_chunking(sjqbn_dataset_t *data) {
+    int varids[SJQBN_PROP_CNT]={ data->vp_varid, data->vs_varid, data->rho_varid };
+    size_t chunks[3];
+    int deflated;
+
+    data->chunked=0;
+    data->deflated=0;
+    data->chunks[0]=1;
+    data->chunks[1]=data->ny;
+    data->chunks[2]=data->nx;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        if(!get_nc_chunking(data->ncid, varids[p], chunks, &deflated)) continue;
+        if(!data->chunked) {
+            memcpy(data->chunks, chunks, sizeof(chunks));
+            data->chunked=1;
+        }
+        for(int a=0; a<3; a++) {
+            if(chunks[a] > data->chunks[a]) data->chunks[a]=chunks[a];
+        }
+        data->deflated|=deflated;
+    }
+    if(sjqbn_ucvm_debug) {
+        fprintf(stderrfp," storage ..%s %zux%zux%zu%s\n", data->chunked ? "chunked" : "contiguous",
+                data->chunks[0], data->chunks[1], data->chunks[2], data->deflated ? " deflated" : "");
+    }
+}
+
+/* chunk caches live per handle and variable */
+static void _tune_chunk_cache(sjqbn_dataset_t *data, int ncid) {
+    int varids[SJQBN_PROP_CNT]={ data->vp_varid, data->vs_varid, data->rho_varid };
+
+    if(!data->chunked) return;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        set_nc_layer_chunk_cache(ncid, varids[p], data->chunks, data->ny, data->nx, SJQBN_CHUNK_CACHE_MAX);
+    }
+}
+
+/**** volume loading ****/
+/* one piece of loading work, depth slabs [z_begin,z_end) of one property */
+typedef struct sjqbn_load_job_t {
+        int prop;
+        int z_begin;
+        int z_end;
+} sjqbn_load_job_t;
+
+typedef struct sjqbn_loader_t {
+        sjqbn_dataset_t *data;
+        int varids[SJQBN_PROP_CNT];
+        float *volumes[SJQBN_PROP_CNT];
+        sjqbn_load_job_t *jobs;
+        int job_cnt;
+        int job_slabs;      /* slabs per job, the last may have fewer */
+        int next_job;       /* next job to take, atomic */
+        int serialize;      /* one netCDF read at a time */
+        int whole_var;      /* jobs are whole variables read by nc_get_var_float */
+        pthread_mutex_t read_lock;
+} sjqbn_loader_t;
+
+typedef struct sjqbn_load_worker_t {
+        sjqbn_loader_t *loader;
+        int ncid;           /* this thread's handle */
+        int rc;
+} sjqbn_load_worker_t;
+
+/* netCDF-4 files go through HDF5, which is not safe to call from two
+   threads even on separate handles */
+static int _serial_format(int ncid) {
+    int fmt=NC_FORMAT_CLASSIC;
+    nc_inq_format(ncid, &fmt);
+    return (fmt == NC_FORMAT_NETCDF4 || fmt == NC_FORMAT_NETCDF4_CLASSIC);
+}
+
+static double _now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* read depth slabs [z_begin,z_end) of one property and place them in
+   the dataset's node ordering, scratch holds what needs reordering */
+static int _load_slabs(sjqbn_loader_t *ld, int ncid, sjqbn_load_job_t *job, float *scratch) {
+    sjqbn_dataset_t *data=ld->data;
+    float *dst=ld->volumes[job->prop];
+    size_t slab=(size_t)data->nx * data->ny;
+    size_t start[3]={ data->z0 + job->z_begin, data->y0, data->x0 };
+    size_t count[3]={ job->z_end - job->z_begin, data->ny, data->nx };
+    float *buf= (data->layout == SJQBN_LAYOUT_SLAB) ? dst + job->z_begin * slab : scratch;
+
+    int rc;
+    if(ld->serialize) pthread_mutex_lock(&ld->read_lock);
+    if(ld->whole_var) {
+        rc=nc_get_var_float(ncid, ld->varids[job->prop], buf);
+        } else {
+            rc=cache_tile_float(ncid, ld->varids[job->prop], start, count, buf);
+    }
+    if(ld->serialize) pthread_mutex_unlock(&ld->read_lock);
+    if(rc != NC_NOERR) return FAIL;
+
+    if(data->layout == SJQBN_LAYOUT_COLUMN) { // gather, writes stay sequential
+        for(size_t col=0; col<slab; col++) {
+            float *out=dst + col*data->nz;
+            for(int z=job->z_begin; z<job->z_end; z++) {
+                out[z]=buf[(z-job->z_begin)*slab+col];
+            }
+        }
+    }
+    if(data->layout == SJQBN_LAYOUT_BRICK) {
+        size_t n=0;
+        for(int z=job->z_begin; z<job->z_end; z++) {
+            for(int y=0; y<data->ny; y++) {
+                for(int x=0; x<data->nx; x++) {
+                    dst[_layout_offset(data,x,y,z)]=buf[n++];
+                }
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+/* one loading thread, takes jobs until none are left */
+static void *_load_worker(void *arg) {
+    sjqbn_load_worker_t *w=(sjqbn_load_worker_t *)arg;
+    sjqbn_loader_t *ld=w->loader;
+    size_t slab=(size_t)ld->data->nx * ld->data->ny;
+    float *scratch=NULL;
+
+    if(ld->data->layout != SJQBN_LAYOUT_SLAB) {
+        scratch=(float *)malloc(ld->job_slabs * slab * sizeof(float));
+        if(scratch == NULL) {
+            fprintf(stderr, "load: malloc failed\n");
+            w->rc=FAIL;
+            return NULL;
+        }
+    }
+
+    int j;
+    while((j=__atomic_fetch_add(&ld->next_job, 1, __ATOMIC_RELAXED)) < ld->job_cnt) {
+        if(_load_slabs(ld, w->ncid, &ld->jobs[j], scratch) != SUCCESS) w->rc=FAIL;
+    }
+    free(scratch);
+    return NULL;
+}
+
+/* how many loading threads, 0 asks for one per online cpu */
+static int _load_thread_cnt(sjqbn_configuration_t *config) {
+    int n=config->load_threads;
+    if(n <= 0) n=sysconf(_SC_NPROCESSORS_ONLN);
+    if(n > SJQBN_LOAD_THREADS_MAX) n=SJQBN_LOAD_THREADS_MAX;
+    return (n < 1) ? 1 : n;
+}
+
+/**
+ * Reads vp/vs/rho into freshly allocated volumes. Each property is cut
+ * into depth slab ranges and the ranges are shared out between
+ * load_threads threads, each with its own netCDF handle. Range bounds
+ * fall on chunk boundaries of the file so no chunk is decompressed by
+ * two reads. With chunk_reads off each variable is read whole on one
+ * thread, as the loader used to.
+ *
+ * @return SUCCESS or FAIL
+ */
+static int _load_volumes(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    sjqbn_loader_t ld;
+    sjqbn_load_worker_t workers[SJQBN_LOAD_THREADS_MAX];
+    pthread_t tids[SJQBN_LOAD_THREADS_MAX];
+    size_t bytes=data->store_elems * sizeof(float);
+    int nthreads=config->chunk_reads ? _load_thread_cnt(config) : 1;
+    int rc=SUCCESS;
+
+    memset(&ld, 0, sizeof(ld));
+    ld.data=data;
+    ld.varids[SJQBN_VP_IDX]=data->vp_varid;
+    ld.varids[SJQBN_VS_IDX]=data->vs_varid;
+    ld.varids[SJQBN_RHO_IDX]=data->rho_varid;
+    ld.serialize=_serial_format(data->ncid);
+    pthread_mutex_init(&ld.read_lock, NULL);
+
+    // allocations count pages and bind NUMA placement, keep them here
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        ld.volumes[p]=(float *)alloc_sjqbn_volume(data, bytes);
+        if(ld.volumes[p] == NULL) rc=FAIL;
+    }
+
+    // enough slab ranges per property to keep every thread busy, whole
+    // chunks deep and cut on chunk boundaries in the file's depth index
+    int chunk_z=data->chunks[0];
+    ld.job_slabs=(data->nz + nthreads-1) / nthreads;
+    ld.job_slabs=(ld.job_slabs + chunk_z-1) / chunk_z * chunk_z;
+    ld.whole_var=!config->chunk_reads && !_roi_active(data);
+    if(!config->chunk_reads) ld.job_slabs=data->nz;
+    int ranges=data->nz / ld.job_slabs + 2;
+    ld.jobs=(sjqbn_load_job_t *)malloc(SJQBN_PROP_CNT * ranges * sizeof(sjqbn_load_job_t));
+    if(ld.jobs == NULL) rc=FAIL;
+    for(int z=0; rc == SUCCESS && z<data->nz; ) {
+        int z_end=((data->z0 + z) / ld.job_slabs + 1) * ld.job_slabs - data->z0;
+        if(z_end > data->nz || !config->chunk_reads) z_end=data->nz;
+        for(int p=0; p<SJQBN_PROP_CNT; p++) {
+            sjqbn_load_job_t *job=&ld.jobs[ld.job_cnt++];
+            job->prop=p;
+            job->z_begin=z;
+            job->z_end=z_end;
+        }
+        z=z_end;
+    }
+
+    // handles are opened here, the library's file list is not thread safe
+    int started=0;
+    for(int t=0; rc == SUCCESS && t<nthreads; t++) {
+        workers[t].loader=&ld;
+        workers[t].rc=SUCCESS;
+        workers[t].ncid=data->ncid;
+        if(t > 0 && nc_open(filepath, NC_NOWRITE, &workers[t].ncid) != NC_NOERR) break;
+        if(t > 0) _tune_chunk_cache(data, workers[t].ncid);
+        if(t > 0 && pthread_create(&tids[t], NULL, _load_worker, &workers[t]) != 0) {
+            nc_close(workers[t].ncid);
+            break;
+        }
+        started++;
+    }
+    if(started > 0) _load_worker(&workers[0]);
+    for(int t=1; t<started; t++) {
+        pthread_join(tids[t], NULL);
+        nc_close(workers[t].ncid);
+    }
+    for(int t=0; t<started; t++) {
+        if(workers[t].rc != SUCCESS) rc=FAIL;
+    }
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," loaded %d slab ranges on %d threads%s\n", ld.job_cnt, started, ld.serialize ? ", reads serialized" : "");
+
+    data->vp_buffer=ld.volumes[SJQBN_VP_IDX];
+    data->vs_buffer=ld.volumes[SJQBN_VS_IDX];
+    data->rho_buffer=ld.volumes[SJQBN_RHO_IDX];
+    free(ld.jobs);
+    pthread_mutex_destroy(&ld.read_lock);
+    return rc;
+}
+
+
+/**** NODATA ****/
+static inline int _valid_bit(uint64_t *bits, size_t i) {
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
+static size_t _valid_bytes(sjqbn_dataset_t *data) {
+    return (((size_t)data->nx * data->ny * data->nz + 63) >> 6) * sizeof(uint64_t);
+}
+
+/* node is NaN or one of its variable's fill/missing values in any property */
+static int _node_missing(float **src, size_t off, float fills[][SJQBN_FILL_MAX], int *nfills) {
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        float v=src[p][off];
+        if(isnan(v)) return 1;
+        for(int f=0; f<nfills[p]; f++) {
+            if(v == fills[p][f]) return 1;
+        }
+    }
+    return 0;
+}
+
+/* validity bitmaps of the float volumes, left NULL when nothing is missing */
+static int _build_validity(sjqbn_dataset_t *data, float **src) {
+    int varids[SJQBN_PROP_CNT]={ data->vp_varid, data->vs_varid, data->rho_varid };
+    float fills[SJQBN_PROP_CNT][SJQBN_FILL_MAX];
+    int nfills[SJQBN_PROP_CNT];
+    int nx=data->nx, ny=data->ny, nz=data->nz;
+    size_t bytes=_valid_bytes(data);
+    size_t layer=(size_t)nx * ny;
+    size_t bad=0, i=0;
+
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        nfills[p]=get_nc_fill_values(data->ncid, varids[p], fills[p], SJQBN_FILL_MAX);
+    }
+
+    uint64_t *node=(uint64_t *)calloc(1, bytes);
+    if(node == NULL) { fprintf(stderr, "validity: malloc failed\n"); return FAIL; }
+    for(int z=0; z<nz; z++) {
+        for(int y=0; y<ny; y++) {
+            for(int x=0; x<nx; x++, i++) {
+                if(_node_missing(src, _layout_offset(data,x,y,z), fills, nfills)) {
+                    bad++;
+                    } else {
+                        node[i >> 6] |= (uint64_t)1 << (i & 63);
+                }
+            }
+        }
+    }
+    if(bad == 0) {
+        free(node);
+        return SUCCESS;
+    }
+
+    uint64_t *cell=(uint64_t *)calloc(1, bytes);
+    if(cell == NULL) { fprintf(stderr, "validity: malloc failed\n"); free(node); return FAIL; }
+    for(int z=0; z+1<nz; z++) {
+        for(int y=0; y+1<ny; y++) {
+            i=((size_t)z * ny + y) * nx;
+            for(int x=0; x+1<nx; x++, i++) {
+                if(_valid_bit(node, i) && _valid_bit(node, i+1) &&
+                          _valid_bit(node, i+nx) && _valid_bit(node, i+nx+1) &&
+                          _valid_bit(node, i+layer) && _valid_bit(node, i+layer+1) &&
+                          _valid_bit(node, i+layer+nx) && _valid_bit(node, i+layer+nx+1)) {
+                    cell[i >> 6] |= (uint64_t)1 << (i & 63);
+                }
+            }
+        }
+    }
+    data->node_valid=node;
+    data->cell_valid=cell;
+    data->invalid_nodes=bad;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," nodata ..%zu of %zu nodes\n", bad, (size_t)nx * ny * nz);
+    return SUCCESS;
+}
+
+/* pack the 3 planar volumes into per node vp/vs/rho records */
+static float *_pack_records(sjqbn_dataset_t *data) {
+    size_t total=data->store_elems;
+    float *records = (float *)alloc_sjqbn_volume(data, total * SJQBN_PROP_CNT * sizeof(float));
+    if (!records) return NULL;
+
+    for(size_t i=0; i<total; i++) {
+        records[i*SJQBN_PROP_CNT+SJQBN_VP_IDX]=data->vp_buffer[i];
+        records[i*SJQBN_PROP_CNT+SJQBN_VS_IDX]=data->vs_buffer[i];
+        records[i*SJQBN_PROP_CNT+SJQBN_RHO_IDX]=data->rho_buffer[i];
+    }
+    return records;
+}
+
+/* IEEE binary16, round to nearest even */
+static uint16_t _float_to_half(float f) {
+    union { float f; uint32_t u; } v = { f };
+    uint32_t sign=(v.u >> 16) & 0x8000;
+    int32_t exp=((v.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant=v.u & 0x7fffff;
+
+    if(((v.u >> 23) & 0xff) == 0xff) { // inf or nan
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    }
+    if(exp >= 31) return sign | 0x7c00;
+    if(exp <= 0) { // subnormal or zero
+        if(exp < -10) return sign;
+        mant |= 0x800000;
+        int shift=14 - exp;
+        uint32_t half=mant >> shift;
+        uint32_t rem=mant & ((1u << shift)-1);
+        uint32_t mid=1u << (shift-1);
+        if(rem > mid || (rem == mid && (half & 1))) half++;
+        return sign | half;
+    }
+    uint32_t half=sign | (exp << 10) | (mant >> 13);
+    uint32_t rem=mant & 0x1fff;
+    if(rem > 0x1000 || (rem == 0x1000 && (half & 1))) half++;
+    return half;
+}
+
+static inline float _half_to_float(uint16_t h) {
+    union { float f; uint32_t u; } v;
+    uint32_t sign=(uint32_t)(h & 0x8000) << 16;
+    uint32_t exp=(h >> 10) & 0x1f;
+    uint32_t mant=h & 0x3ff;
+
+    if(exp == 0) { // zero or subnormal
+        v.f=mant * (1.0f / 16777216.0f);
+        v.u |= sign;
+        return v.f;
+    }
+    if(exp == 31) {
+        v.u=sign | 0x7f800000 | (mant << 13);
+        return v.f;
+    }
+    v.u=sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    return v.f;
+}
+
+/* per depth slab range of each property, for fixed16 */
+static int _setup_slab_scales(sjqbn_dataset_t *data, float **src) {
+    int nz=data->nz;
+    data->slab_base=(float *)malloc(SJQBN_PROP_CNT * nz * sizeof(float));
+    data->slab_scale=(float *)malloc(SJQBN_PROP_CNT * nz * sizeof(float));
+    if(!data->slab_base || !data->slab_scale) { fprintf(stderr, "slab scale: malloc failed\n"); return FAIL; }
+
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        for(int z=0; z<nz; z++) {
+            float lo=INFINITY, hi=-INFINITY;
+            for(int y=0; y<data->ny; y++) {
+                for(int x=0; x<data->nx; x++) {
+                    // missing nodes would stretch the range
+                    if(data->node_valid != NULL && !_valid_bit(data->node_valid, ((size_t)z * data->ny + y) * data->nx + x)) continue;
+                    float v=src[p][_layout_offset(data,x,y,z)];
+                    if(v < lo) lo=v;
+                    if(v > hi) hi=v;
+                }
+            }
+            if(lo > hi) lo=hi=0;  // nothing valid
+            data->slab_base[p*nz+z]=lo;
+            data->slab_scale[p*nz+z]=(hi > lo) ? (hi - lo) / 65535.0f : 0;
+        }
+    }
+    return SUCCESS;
+}
+
+/* reduce the float volumes to 16 bit storage and note the worst error */
+static int _pack_precision(sjqbn_dataset_t *data, int precision, int interleave) {
+    size_t total=data->store_elems;
+    float *src[SJQBN_PROP_CNT]={ data->vp_buffer, data->vs_buffer, data->rho_buffer };
+    uint16_t *dst[SJQBN_PROP_CNT];
+    int stride=interleave ? SJQBN_PROP_CNT : 1;
+    int nz=data->nz;
+
+    if(precision == SJQBN_PRECISION_FIXED16 && _setup_slab_scales(data, src) != SUCCESS) {
+        return FAIL;
+    }
+
+    if(interleave) {
+        data->packed_records=(uint16_t *)alloc_sjqbn_volume(data, total * SJQBN_PROP_CNT * sizeof(uint16_t));
+        if (!data->packed_records) return FAIL;
+        for(int p=0; p<SJQBN_PROP_CNT; p++) dst[p]=data->packed_records + p;
+        } else {
+            for(int p=0; p<SJQBN_PROP_CNT; p++) {
+                data->packed[p]=(uint16_t *)alloc_sjqbn_volume(data, total * sizeof(uint16_t));
+                if (!data->packed[p]) return FAIL;
+                dst[p]=data->packed[p];
+            }
+    }
+
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        float err=0;
+        for(int z=0; z<nz; z++) {
+            float base=0, scale=0;
+            if(precision == SJQBN_PRECISION_FIXED16) {
+                base=data->slab_base[p*nz+z];
+                scale=data->slab_scale[p*nz+z];
+            }
+            for(int y=0; y<data->ny; y++) {
+                for(int x=0; x<data->nx; x++) {
+                    size_t off=_layout_offset(data,x,y,z);
+                    float v=src[p][off];
+                    float back;
+                    uint16_t q;
+                    if(precision == SJQBN_PRECISION_HALF) {
+                        q=_float_to_half(v);
+                        back=_half_to_float(q);
+                        } else {
+                            float r=(scale > 0) ? rintf((v - base) / scale) : 0;
+                            if(r < 0) r=0;
+                            if(r > 65535) r=65535;
+                            q=(uint16_t)r;
+                            back=base + q * scale;
+                    }
+                    dst[p][off*stride]=q;
+                    if(data->node_valid != NULL && !_valid_bit(data->node_valid, ((size_t)z * data->ny + y) * data->nx + x)) continue;
+                    if(fabsf(back - v) > err) err=fabsf(back - v);
+                }
+            }
+        }
+        data->quant_error[p]=err;
+    }
+    data->precision=precision;
+    return SUCCESS;
+}
+
+static void _drop_float_buffers(sjqbn_dataset_t *data) {
+    size_t bytes=data->store_elems * sizeof(float);
+    free_sjqbn_volume(data, data->vp_buffer, bytes);
+    free_sjqbn_volume(data, data->vs_buffer, bytes);
+    free_sjqbn_volume(data, data->rho_buffer, bytes);
+    data->vp_buffer=NULL;
+    data->vs_buffer=NULL;
+    data->rho_buffer=NULL;
+}
+
+/* open the netCDF file, read the axes and look up the property variables */
+static void _load_axes(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    size_t nelems= 0;
+    nc_type vtype;
 
 /* setup ncid */
     data->ncid=open_nc(filepath);
@@ -55,88 +681,651 @@ sjqbn_dataset_t *make_a_sjqbn_dataset(char *datadir, char *datafile, int tooBig)
     data->vs_varid=get_nc_varid(data->ncid,"vs",filepath);
     data->rho_varid=get_nc_varid(data->ncid,"rho",filepath);
 
-    data->in_memory =0;
+/* from here on the grid is the region of interest */
+    memcpy(data->roi, config->roi, sizeof(data->roi));
+    data->x0=_roi_axis(data->longitudes, &data->nx, data->roi[SJQBN_ROI_LON]);
+    data->y0=_roi_axis(data->latitudes, &data->ny, data->roi[SJQBN_ROI_LAT]);
+    data->z0=_roi_axis(data->depths, &data->nz, data->roi[SJQBN_ROI_DEPTH]);
+    if(sjqbn_ucvm_debug && _roi_active(data)) {
+        fprintf(stderrfp," roi ..%d x %d x %d from %d/%d/%d\n", data->nx, data->ny, data->nz, data->x0, data->y0, data->z0);
+    }
 
-/* load all vp/vs/rho data in memory */
-    int total= data->nx * data->ny * data->nz;
+    _inspect_chunking(data);
+    if(config->chunk_reads) _tune_chunk_cache(data, data->ncid);
+}
 
-    data->vp_buffer = (float *)malloc(total * sizeof(float));
-    data->vs_buffer = (float *)malloc(total * sizeof(float));
-    data->rho_buffer = (float *)malloc(total * sizeof(float));
+/* leave the properties in the file, queries go through a tile cache
+   over the brick layout with the tile as brick */
+static int _load_tiled(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    int varids[SJQBN_PROP_CNT]={ data->vp_varid, data->vs_varid, data->rho_varid };
+    int origin[3]={ data->x0, data->y0, data->z0 };
+    int tile_size=(config->tile_size > 0) ? config->tile_size : SJQBN_TILE_SIZE;
+    size_t budget=(size_t)((config->tile_cache_mb > 0) ? config->tile_cache_mb : SJQBN_TILE_CACHE_MB) << 20;
 
-    data->vp_buffer=get_nc_float_buffer(data->ncid, "vp", filepath, &vtype, &nelems, 3);
-    data->vs_buffer=get_nc_float_buffer(data->ncid, "vs", filepath, &vtype, &nelems, 3);
-    data->rho_buffer=get_nc_float_buffer(data->ncid, "rho", filepath, &vtype, &nelems, 3);
+    setup_sjqbn_layout(data, SJQBN_LAYOUT_BRICK, tile_size);
+    data->elems=(size_t)data->nx * data->ny * data->nz;
+    data->tiles=make_sjqbn_tile_cache(data->ncid, varids, origin, data->nx, data->ny, data->nz, data->brick_shift, budget);
+    if(data->tiles == NULL) {
+        fprintf(stderr, "tiled: no tile cache for %s\n", filepath);
+        return FAIL;
+    }
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," tiled access ..%d^3 tiles, %d cached\n", 1 << data->brick_shift, data->tiles->slot_cnt);
+    return SUCCESS;
+}
+
+/* leave the properties in the file, queries read each batch's nodes
+   from a tiled image of it, written here if there is no current one */
+static int _load_disk(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    char path[300];
+    int tile_size=(config->tile_size > 0) ? config->tile_size : SJQBN_TILE_SIZE;
+
+    setup_sjqbn_layout(data, SJQBN_LAYOUT_BRICK, tile_size);
+    data->elems=(size_t)data->nx * data->ny * data->nz;
+    snprintf(path, sizeof(path), "%s%s", filepath, SJQBN_DISK_SUFFIX);
+
+    double t0=_now();
+    data->disk=sjqbn_disk_open(data, path, filepath, config->io_engine, config->io_threads);
+    if(data->disk == NULL && sjqbn_disk_write(data, path, filepath) == SUCCESS) {
+        data->load_seconds[SJQBN_PHASE_VOLUMES]=_now() - t0;
+        data->disk=sjqbn_disk_open(data, path, filepath, config->io_engine, config->io_threads);
+    }
+    return (data->disk != NULL) ? SUCCESS : FAIL;
+}
+
+static void _release_disk(sjqbn_dataset_t *data) {
+    sjqbn_disk_close(data->disk);
+    data->disk=NULL;
+}
 
+/* reserve the slab volumes only, pages get committed as slabs are filled,
+   by the queries or with async_load a background thread */
+static int _load_lazy(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    size_t bytes;
+
+    setup_sjqbn_layout(data, SJQBN_LAYOUT_SLAB, 0);
+    bytes=data->store_elems * sizeof(float);
+    data->elems=(size_t)data->nx * data->ny * data->nz;
+    data->lazy=1;
+    data->vp_buffer=(float *)alloc_sjqbn_volume(data, bytes);
+    data->vs_buffer=(float *)alloc_sjqbn_volume(data, bytes);
+    data->rho_buffer=(float *)alloc_sjqbn_volume(data, bytes);
+    data->slab_ready=(unsigned char *)calloc(data->nz, sizeof(unsigned char));
+    pthread_mutex_init(&data->slab_lock, NULL);
+    data->slabs_loaded=0;
+    data->lazy=1;
+    data->async=config->async_load;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," lazy slabs ..%d\n", data->nz);
+    if(!data->vp_buffer || !data->vs_buffer || !data->rho_buffer || !data->slab_ready) {
+        fprintf(stderr, "lazy: no memory for the slabs of %s\n", filepath);
+        return FAIL;
+    }
+    return SUCCESS;
+}
+
+/* fill depth slab z of all properties if no query has yet, the lock
+   also keeps netCDF calls to one thread */
+static int _fill_slab(sjqbn_dataset_t *data, int z) {
+    size_t layer=(size_t)z * data->z_stride;
+    int rc=SUCCESS;
+
+    pthread_mutex_lock(&data->slab_lock);
+    if(!data->slab_ready[z]) {
+        if(_read_roi_layer(data, data->vp_varid, z, data->vp_buffer+layer) != NC_NOERR ||
+                  _read_roi_layer(data, data->vs_varid, z, data->vs_buffer+layer) != NC_NOERR ||
+                  _read_roi_layer(data, data->rho_varid, z, data->rho_buffer+layer) != NC_NOERR) {
+            rc=FAIL;
+            } else {
+                data->slabs_loaded++;
+                __atomic_store_n(&data->slab_ready[z], 1, __ATOMIC_RELEASE);
+                if(sjqbn_ucvm_debug) fprintf(stderrfp," lazy slab %d loaded\n", z);
+        }
+    }
+    pthread_mutex_unlock(&data->slab_lock);
+    return rc;
+}
+
+/* background fill, top slab down since most queries are shallow */
+static void *_fill_worker(void *arg) {
+    sjqbn_dataset_t *data=(sjqbn_dataset_t *)arg;
+    double t0=_now();
+    int rc=SUCCESS;
+
+    for(int z=0; z<data->nz && !__atomic_load_n(&data->fill_stop, __ATOMIC_RELAXED); z++) {
+        if(!__atomic_load_n(&data->slab_ready[z], __ATOMIC_ACQUIRE) && _fill_slab(data, z) != SUCCESS) rc=FAIL;
+    }
+
+    pthread_mutex_lock(&data->slab_lock);
+    data->fill_rc=rc;
+    data->fill_done=1;
+    data->load_seconds[SJQBN_PHASE_VOLUMES]=_now() - t0;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," background load done in %.3fs\n", data->load_seconds[SJQBN_PHASE_VOLUMES]);
+    pthread_cond_broadcast(&data->fill_cond);
+    pthread_mutex_unlock(&data->slab_lock);
+    return NULL;
+}
+
+/**
+ * Starts streaming the slabs of an async dataset in on a background
+ * thread. Called once every dataset is open, netCDF handles must not
+ * be opened while the thread reads. If no thread can be started the
+ * slabs are still read by the queries that need them.
+ */
+void start_sjqbn_dataset_fill(sjqbn_dataset_t *data) {
+    if(!data->async || data->fill_started) return;
+    pthread_cond_init(&data->fill_cond, NULL);
+    if(pthread_create(&data->filler, NULL, _fill_worker, data) != 0) {
+        fprintf(stderr, "sjqbn: no background loader, slabs load on first use\n");
+        pthread_cond_destroy(&data->fill_cond);
+        data->async=0;
+        return;
+    }
+    data->fill_started=1;
+}
+
+/**
+ * Blocks until the background thread has read every slab.
+ *
+ * @return SUCCESS, or FAIL if a slab could not be read
+ */
+int wait_sjqbn_dataset_fill(sjqbn_dataset_t *data) {
+    int rc;
+
+    if(!data->fill_started) return SUCCESS;
+    pthread_mutex_lock(&data->slab_lock);
+    while(!data->fill_done) pthread_cond_wait(&data->fill_cond, &data->slab_lock);
+    rc=data->fill_rc;
+    pthread_mutex_unlock(&data->slab_lock);
+    return rc;
+}
+
+/* slabs z0..z1 are in memory, read them if not */
+static inline int _ensure_slabs(sjqbn_dataset_t *data, int z0, int z1) {
+    for(int z=z0; z<=z1; z++) {
+        if(!__atomic_load_n(&data->slab_ready[z], __ATOMIC_ACQUIRE) && _fill_slab(data, z) != SUCCESS) {
+            return FAIL;
+        }
+    }
+    return SUCCESS;
+}
+
+/* wall clock of each load phase */
+static void _report_phases(sjqbn_dataset_t *data) {
+    if(sjqbn_ucvm_debug) {
+        fprintf(stderrfp," load phases: axes %.3fs volumes %.3fs pack %.3fs\n", data->load_seconds[SJQBN_PHASE_AXES],
+                data->load_seconds[SJQBN_PHASE_VOLUMES], data->load_seconds[SJQBN_PHASE_PACK]);
+    }
+}
+
+/* read the float slab volumes and keep only their depth runs, the
+   encoding is timed as the pack phase */
+static int _load_rle(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    float *volumes[SJQBN_PROP_CNT];
+    double t0=_now(), t1;
+
+    setup_sjqbn_layout(data, SJQBN_LAYOUT_SLAB, 0);
+    data->elems=(size_t)data->nx * data->ny * data->nz;
+    if(_load_volumes(data, config, filepath) != SUCCESS) {
+        data->backend=NULL;
+        return FAIL;
+    }
+    t1=_now();
+    data->load_seconds[SJQBN_PHASE_VOLUMES]=t1 - t0;
+    volumes[SJQBN_VP_IDX]=data->vp_buffer;
+    volumes[SJQBN_VS_IDX]=data->vs_buffer;
+    volumes[SJQBN_RHO_IDX]=data->rho_buffer;
+    _build_validity(data, volumes);
+    data->rle=make_sjqbn_rle(volumes, data->nx, data->ny, data->nz);
+    if(data->rle == NULL) {  // stays dense
+        data->backend=NULL;
+        return SUCCESS;
+    }
+    _drop_float_buffers(data);
+    data->load_seconds[SJQBN_PHASE_PACK]=_now() - t1;
+    if(sjqbn_ucvm_debug) {
+        fprintf(stderrfp," rle ..%zu runs for %zu nodes, %zu bytes (dense %zu)\n", data->rle->run_cnt, data->elems,
+                sjqbn_rle_bytes(data->rle), data->elems * SJQBN_PROP_CNT * sizeof(float));
+    }
+    return SUCCESS;
+}
+
+/* all vp/vs/rho in memory in the configured layout and precision */
+static int _load_dense(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath) {
+    size_t total= (size_t)data->nx * data->ny * data->nz;
+    double t0=_now(), t1;
+    int rc=SUCCESS;
+
+    setup_sjqbn_layout(data, config->layout, config->brick_size);
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," layout ..%d (%zu nodes)\n", data->layout, data->store_elems);
+
+    data->huge_pages=config->huge_pages;
+    rc=_load_volumes(data, config, filepath);
     data->elems=total;
+    t1=_now();
+    data->load_seconds[SJQBN_PHASE_VOLUMES]=t1 - t0;
+
+/* holes are found on the float values, before any narrowing */
+    if(data->vp_buffer != NULL) {
+        float *src[SJQBN_PROP_CNT]={ data->vp_buffer, data->vs_buffer, data->rho_buffer };
+        _build_validity(data, src);
+    }
+
+/* narrow to 16 bit, interleaved or not, the float volumes are dropped after */
+    if(config->precision != SJQBN_PRECISION_FLOAT) {
+        if(_pack_precision(data, config->precision, config->interleave) == SUCCESS) {
+            _drop_float_buffers(data);
+            data->interleaved=config->interleave;
+        }
+        if(sjqbn_ucvm_debug) {
+            fprintf(stderrfp," precision ..%d, max error vp %g vs %g rho %g\n", data->precision,
+                    data->quant_error[SJQBN_VP_IDX], data->quant_error[SJQBN_VS_IDX], data->quant_error[SJQBN_RHO_IDX]);
+        }
+    }
+
+/* repack into node records, done once here so the queries only see one layout */
+    if(config->interleave && data->precision == SJQBN_PRECISION_FLOAT) {
+        data->records=_pack_records(data);
+        if(data->records != NULL) {
+            _drop_float_buffers(data);
+            data->interleaved=1;
+        }
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," interleaved records ..%s\n", data->interleaved?"on":"off");
+    }
+
+    data->load_seconds[SJQBN_PHASE_PACK]=_now() - t1;
+    _report_pages(data);
+    return rc;
+}
+
+/* storage backend the configuration asks for */
+static const sjqbn_backend_t *_pick_backend(sjqbn_dataset_t *data, sjqbn_configuration_t *config, int tooBig) {
+    if(config->backend[0] != '\0') {
+        const sjqbn_backend_t *named=sjqbn_find_backend(config->backend);
+        if(named != NULL) return named;
+        fprintf(stderr, "sjqbn: no storage backend %s, using the configured storage\n", config->backend);
+    }
+/* asked for: read each query batch from disk */
+    if(config->access == SJQBN_ACCESS_DISK) return &sjqbn_disk_backend;
+/* larger than memory allows, or asked for: read on demand instead */
+    if(config->access == SJQBN_ACCESS_TILED || (tooBig && sjqbn_too_big(data))) return &sjqbn_tiled_backend;
+/* float slabs as in the file, so each one is a single layer read */
+    if(config->lazy || config->async_load) return &sjqbn_lazy_backend;
+/* float slabs read as usual, then encoded */
+    if(config->rle) return &sjqbn_rle_backend;
+    return &sjqbn_dense_backend;
+}
+
+/* read the netCDF file and build the configured storage in memory */
+static int _load_dataset(sjqbn_dataset_t *data, sjqbn_configuration_t *config, char *filepath, int tooBig) {
+    double t0=_now();
+
+    _load_axes(data, config, filepath);
+    data->load_seconds[SJQBN_PHASE_AXES]=_now() - t0;
+
+    data->in_memory =0;
+    data->interleaved =0;
+    data->records =NULL;
+    data->precision =SJQBN_PRECISION_FLOAT;
+    data->packed_records =NULL;
+    data->slab_base =NULL;
+    data->slab_scale =NULL;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        data->packed[p]=NULL;
+        data->quant_error[p]=0;
+    }
+
+/* dense storage keeps no backend, the queries inline it */
+    const sjqbn_backend_t *backend=_pick_backend(data, config, tooBig);
+    data->backend=(backend == &sjqbn_dense_backend) ? NULL : backend;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," storage backend ..%s\n", backend->name);
+    if(backend->load(data, config, filepath) != SUCCESS) {
+        fprintf(stderr, "sjqbn: %s storage of %s failed to load\n", backend->name, filepath);
+        return FAIL;
+    }
+    _report_phases(data);
+    return SUCCESS;
+}
+
+/**** NUMA replicas ****/
+static void *_replicate_volume(sjqbn_dataset_t *replica, void *src, size_t bytes) {
+    if(src == NULL) return NULL;
+    void *dst=alloc_sjqbn_volume(replica, bytes);
+    if(dst != NULL) memcpy(dst, src, bytes);
+    return dst;
+}
+
+/* one copy of the property storage per extra node, the loaded dataset
+   itself serves node 0 */
+static void _make_replicas(sjqbn_dataset_t *data) {
+    size_t nodes=data->store_elems;
+
+    data->replicas[0]=data;
+    for(int n=1; n<data->numa_nodes; n++) {
+        sjqbn_dataset_t *r=(sjqbn_dataset_t *)malloc(sizeof(sjqbn_dataset_t));
+        if(r == NULL) break;
+        *r=*data;
+        r->replica_of=data;
+        r->numa_node=n;
+        r->cache_map=NULL;
+        r->shm_name[0]='\0';
+        r->shm_fd=-1;
+        r->prefetch=0;
+        for(int i=0; i<SJQBN_NUMA_MAX; i++) r->replicas[i]=NULL;
+
+        r->vp_buffer=_replicate_volume(r, data->vp_buffer, nodes * sizeof(float));
+        r->vs_buffer=_replicate_volume(r, data->vs_buffer, nodes * sizeof(float));
+        r->rho_buffer=_replicate_volume(r, data->rho_buffer, nodes * sizeof(float));
+        r->records=_replicate_volume(r, data->records, nodes * SJQBN_PROP_CNT * sizeof(float));
+        for(int p=0; p<SJQBN_PROP_CNT; p++) {
+            r->packed[p]=_replicate_volume(r, data->packed[p], nodes * sizeof(uint16_t));
+        }
+        r->packed_records=_replicate_volume(r, data->packed_records, nodes * SJQBN_PROP_CNT * sizeof(uint16_t));
+        data->replicas[n]=r;
+    }
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," replicated model on %d NUMA nodes\n", data->numa_nodes);
+}
+
+/* a replica only owns its property volumes */
+static void _free_replica(sjqbn_dataset_t *r) {
+    size_t nodes=r->store_elems;
+    free_sjqbn_volume(r, r->vp_buffer, nodes * sizeof(float));
+    free_sjqbn_volume(r, r->vs_buffer, nodes * sizeof(float));
+    free_sjqbn_volume(r, r->rho_buffer, nodes * sizeof(float));
+    free_sjqbn_volume(r, r->records, nodes * SJQBN_PROP_CNT * sizeof(float));
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        free_sjqbn_volume(r, r->packed[p], nodes * sizeof(uint16_t));
+    }
+    free_sjqbn_volume(r, r->packed_records, nodes * SJQBN_PROP_CNT * sizeof(uint16_t));
+    free(r);
+}
+
+/* the copy a query on the calling thread should read */
+sjqbn_dataset_t *get_local_sjqbn_dataset(sjqbn_dataset_t *data) {
+    if(data->numa_policy != SJQBN_NUMA_REPLICATE) return data;
+    sjqbn_dataset_t *r=data->replicas[sjqbn_numa_current_node() % data->numa_nodes];
+    return (r != NULL) ? r : data;
+}
+
+/* nodes of the region of interest, from the axes alone */
+static size_t _probe_nodes(sjqbn_configuration_t *config, char *filepath) {
+    char *axes[3]={ "longitude", "latitude", "depth" };  // SJQBN_ROI_LON/LAT/DEPTH
+    size_t nodes=1;
+    size_t nelems;
+    nc_type vtype;
+    int first;
+
+    int ncid=open_nc(filepath);
+    for(int a=0; a<3; a++) {
+        float *axis=(float *) get_nc_buffer(ncid, axes[a], filepath, &vtype, &nelems, 1);
+        nodes*=_roi_window(axis, nelems, config->roi[a], &first);
+        free(axis);
+    }
+    nc_close(ncid);
+    return nodes;
+}
+
+/* access = auto: settle config on the first storage that suits the
+   memory budget, full float volumes, 16 bit volumes, a current cache
+   image the page cache can hold, else tiles; the choice is always
+   reported, debug or not */
+static void _choose_backend(sjqbn_configuration_t *config, char *filepath, char *cachepath) {
+    size_t nodes=_probe_nodes(config, filepath);
+    size_t budget=sjqbn_memory_budget(config);
+    size_t phys=(size_t) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    size_t image;
+    char *choice;
+
+    config->access=SJQBN_ACCESS_MEMORY;
+    if(nodes * SJQBN_PROP_CNT * sizeof(float) <= budget) {
+        choice="memory";
+        } else if(nodes * SJQBN_PROP_CNT * sizeof(uint16_t) <= budget) {
+            if(config->precision == SJQBN_PRECISION_FLOAT) config->precision=SJQBN_PRECISION_FIXED16;
+            choice="reduced precision";
+        } else if((image=sjqbn_cache_probe(config, cachepath, filepath)) > 0 && image <= phys) {
+            config->model_cache=1;
+            choice="mapped cache image";
+        } else {
+            size_t mb=(config->tile_cache_mb > 0) ? config->tile_cache_mb : SJQBN_TILE_CACHE_MB;
+            if(mb > (budget >> 20) / 2) mb=(budget >> 20) / 2;
+            config->access=SJQBN_ACCESS_TILED;
+            config->tile_cache_mb=(mb > 0) ? mb : 1;
+            choice="tiled";
+    }
+/* lazy, async and rle all go through whole float volumes, which the
+   budget just ruled out */
+    if(nodes * SJQBN_PROP_CNT * sizeof(float) > budget) {
+        config->lazy=0;
+        config->async_load=0;
+        config->rle=0;
+    }
+    fprintf(stderr, "sjqbn: access = auto picked %s storage for %zu nodes, budget %zu MB\n", choice, nodes, budget >> 20);
+}
+
+/* the configuration asks for dense storage, the kind a cache image or
+   shared segment holds */
+static int _dense_config(sjqbn_configuration_t *config) {
+    if(config->backend[0] != '\0' && strcmp(config->backend, sjqbn_dense_backend.name) != 0) return 0;
+    return (config->access != SJQBN_ACCESS_TILED && config->access != SJQBN_ACCESS_DISK && !config->lazy && !config->async_load && !config->rle);
+}
+
+/* tooBig: use tiled access for grids sjqbn_too_big() rejects; NULL
+   when the storage failed to load */
+sjqbn_dataset_t *make_a_sjqbn_dataset(sjqbn_configuration_t *config, char *datadir, char *datafile, int tooBig) {
+    char filepath[256];
+    char cachepath[300];
+    sjqbn_configuration_t resolved;
+    int shared=FAIL;
+
+    sjqbn_dataset_t *data=(sjqbn_dataset_t *)calloc(1, sizeof(sjqbn_dataset_t));
+    data->ncid=-1;
+    data->shm_fd=-1;
+    data->fault_stats=config->fault_stats;
+
+/* placement only means something with more than one node */
+    data->numa_nodes=sjqbn_numa_nodes();
+    data->numa_policy=(data->numa_nodes > 1) ? config->numa : SJQBN_NUMA_OFF;
+    data->numa_node=(data->numa_policy == SJQBN_NUMA_REPLICATE) ? 0 : -1;
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," NUMA nodes %d, policy %d\n", data->numa_nodes, data->numa_policy);
+
+    sprintf(filepath, "%s/%s", datadir, datafile);
+    sprintf(cachepath, "%s%s", filepath, SJQBN_CACHE_SUFFIX);
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," data file ..%s\n", filepath);
+
+    if(config->access == SJQBN_ACCESS_AUTO) {
+        resolved=*config;
+        _choose_backend(&resolved, filepath, cachepath);
+        config=&resolved;
+    }
+
+/* someone on this node may have loaded it already */
+    if(config->shared_memory && _dense_config(config)) {
+        shared=sjqbn_shm_open(data, config, filepath);
+        if(shared == SJQBN_SHM_ATTACHED) {
+            data->in_memory=1;
+            _setup_axes(data);
+            _setup_residency(data, config);
+            if(data->numa_policy == SJQBN_NUMA_REPLICATE) _make_replicas(data);
+            return data;
+        }
+    }
+
+/* a current binary image of this file skips netCDF altogether */
+    if(!config->model_cache || !_dense_config(config) ||
+              sjqbn_cache_attach(data, config, cachepath, filepath) != SUCCESS) {
+        if(_load_dataset(data, config, filepath, tooBig) != SUCCESS) {
+            // nothing to cache or share, the segment is given up by publish
+            if(shared == SJQBN_SHM_OWNER) sjqbn_shm_publish(data, config, filepath, NULL);
+            free_sjqbn_dataset(data);
+            return NULL;
+        }
+        if(config->model_cache && data->backend == NULL) {
+            sjqbn_cache_write(data, cachepath, filepath);
+        }
+    }
+    if(data->backend != NULL) {
+        // nothing to share or replicate, the segment is given up by publish
+        if(shared == SJQBN_SHM_OWNER) sjqbn_shm_publish(data, config, filepath, NULL);
+        data->in_memory=(data->tiles == NULL && data->disk == NULL);
+        _setup_axes(data);
+        return data;
+    }
     data->in_memory=1;
 
+/* hand it to the node, then use the shared copy like everyone else */
+    if(shared == SJQBN_SHM_OWNER) {
+        sjqbn_dataset_t mapped;
+        if(sjqbn_shm_publish(data, config, filepath, &mapped) == SUCCESS) {
+            _free_storage(data);
+            *data=mapped;
+        }
+    }
+    _setup_axes(data);
+    _setup_residency(data, config);
+    if(data->numa_policy == SJQBN_NUMA_REPLICATE) _make_replicas(data);
+
     return data;
 }
 
 
 int free_sjqbn_dataset(sjqbn_dataset_t *data) {
-    free(data->depths);
-    free(data->latitudes);
-    free(data->longitudes);
-    if(data->vp_buffer != NULL) free(data->vp_buffer);
-    if(data->vs_buffer != NULL) free(data->vs_buffer);
-    if(data->rho_buffer != NULL) free(data->rho_buffer);
-    nc_close(data->ncid);
+    if(sjqbn_ucvm_debug && data->fault_stats) {
+        fprintf(stderrfp," page faults: %ld major %ld minor in %ld batches, %zu bytes pinned\n",
+                data->major_faults, data->minor_faults, data->batches, data->pinned_bytes);
+    }
+    for(int n=1; n<SJQBN_NUMA_MAX; n++) {
+        if(data->replicas[n] != NULL) _free_replica(data->replicas[n]);
+    }
+    _free_storage(data);
+    sjqbn_shm_release(data);
+    if(data->ncid >= 0) nc_close(data->ncid);
+    for(int a=0; a<3; a++) free_sjqbn_axis(&data->axes[a]);
 
     free(data);
     return SUCCESS;
 }
 
+/* axes and property storage, whether malloc'd or mapped */
+static void _free_storage(sjqbn_dataset_t *data) {
+    if(data->backend != NULL && data->backend->release != NULL) data->backend->release(data);
+    free_sjqbn_tile_cache(data->tiles);
+    data->tiles=NULL;
+    free_sjqbn_rle(data->rle);
+    data->rle=NULL;
+    if(data->fill_started) {
+        __atomic_store_n(&data->fill_stop, 1, __ATOMIC_RELAXED);
+        pthread_join(data->filler, NULL);
+        pthread_cond_destroy(&data->fill_cond);
+        data->fill_started=0;
+    }
+    if(data->cache_map != NULL) {
+        sjqbn_cache_detach(data);
+        return;
+    }
+
+    free(data->depths);
+    free(data->latitudes);
+    free(data->longitudes);
+    size_t nodes=data->store_elems;
+    free_sjqbn_volume(data, data->vp_buffer, nodes * sizeof(float));
+    free_sjqbn_volume(data, data->vs_buffer, nodes * sizeof(float));
+    free_sjqbn_volume(data, data->rho_buffer, nodes * sizeof(float));
+    free_sjqbn_volume(data, data->records, nodes * SJQBN_PROP_CNT * sizeof(float));
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        free_sjqbn_volume(data, data->packed[p], nodes * sizeof(uint16_t));
+    }
+    free_sjqbn_volume(data, data->packed_records, nodes * SJQBN_PROP_CNT * sizeof(uint16_t));
+    free(data->node_valid);
+    free(data->cell_valid);
+    if(data->slab_base != NULL) free(data->slab_base);
+    if(data->slab_scale != NULL) free(data->slab_scale);
+    if(data->lazy) {
+        if(sjqbn_ucvm_debug) fprintf(stderrfp," lazy slabs loaded %d of %d\n", data->slabs_loaded, data->nz);
+        free(data->slab_ready);
+        pthread_mutex_destroy(&data->slab_lock);
+        data->slab_ready=NULL;
+        data->lazy=0;
+    }
+    data->depths=NULL;
+    data->latitudes=NULL;
+    data->longitudes=NULL;
+    data->vp_buffer=NULL;
+    data->vs_buffer=NULL;
+    data->rho_buffer=NULL;
+    data->records=NULL;
+    for(int p=0; p<SJQBN_PROP_CNT; p++) data->packed[p]=NULL;
+    data->packed_records=NULL;
+    data->slab_base=NULL;
+    data->slab_scale=NULL;
+    data->node_valid=NULL;
+    data->cell_valid=NULL;
+}
+
 /**** straight or trilinear/bilinear ****/
-int _buffer_offset(sjqbn_dataset_t * dataset, int x_idx, int  y_idx, int z_idx) {
-    int nx=dataset->nx;
-    int ny=dataset->ny;
-    int nz=dataset->nz;
+/* brick (bx,by,bz) is stored whole, nodes inside it in z,y,x order */
+static inline size_t _brick_offset(sjqbn_dataset_t *dataset, int x_idx, int y_idx, int z_idx) {
+    int shift=dataset->brick_shift;
+    int mask=(1 << shift)-1;
 
-    int offset= (z_idx)*(ny * nx)+(y_idx)*(nx)+x_idx;
-    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nTarget offset %d : idx lon/lat/dep = %d/%d/%d\n", offset,x_idx, y_idx, z_idx); }
+    size_t brick= ((size_t)(z_idx >> shift) * dataset->nby + (y_idx >> shift)) * dataset->nbx + (x_idx >> shift);
+    size_t inner= ((size_t)(z_idx & mask) << (2*shift)) | ((y_idx & mask) << shift) | (x_idx & mask);
+    return (brick << (3*shift)) | inner;
+}
 
-    return offset;
+static inline size_t _layout_offset(sjqbn_dataset_t *dataset, int x_idx, int y_idx, int z_idx) {
+    if(dataset->layout == SJQBN_LAYOUT_BRICK) {
+        return _brick_offset(dataset, x_idx, y_idx, z_idx);
+    }
+    return (size_t)(z_idx)*dataset->z_stride+(size_t)(y_idx)*dataset->y_stride+(size_t)(x_idx)*dataset->x_stride;
 }
 
-int get_one_property(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data) {
-    int offset= _buffer_offset(dataset, pt->lon_idx, pt->lat_idx, pt->dep_idx);
+size_t _buffer_offset(sjqbn_dataset_t * dataset, int x_idx, int  y_idx, int z_idx) {
+    size_t offset= _layout_offset(dataset, x_idx, y_idx, z_idx);
+    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nTarget offset %zu : idx lon/lat/dep = %d/%d/%d\n", offset,x_idx, y_idx, z_idx); }
 
-    data->vp=dataset->vp_buffer[offset];
-    data->vs=dataset->vs_buffer[offset];
-    data->rho=dataset->rho_buffer[offset];
     return offset;
 }
 
+/* value of one property at a stored node, widened back to float */
+static inline float _node_value(sjqbn_dataset_t *dataset, int prop, size_t offset, int z_idx) {
+    uint16_t q;
+
+    if(dataset->precision == SJQBN_PRECISION_FLOAT) {
+        if(dataset->interleaved) return dataset->records[offset*SJQBN_PROP_CNT+prop];
+        switch(prop) {
+            case SJQBN_VP_IDX: return dataset->vp_buffer[offset];
+            case SJQBN_VS_IDX: return dataset->vs_buffer[offset];
+            default: return dataset->rho_buffer[offset];
+        }
+    }
+
+    if(dataset->interleaved) {
+        q=dataset->packed_records[offset*SJQBN_PROP_CNT+prop];
+        } else {
+            q=dataset->packed[prop][offset];
+    }
+    if(dataset->precision == SJQBN_PRECISION_HALF) {
+        return _half_to_float(q);
+    }
+    int slab=prop*dataset->nz+z_idx;
+    return dataset->slab_base[slab] + q * dataset->slab_scale[slab];
+}
+
+/* the marker queries give where the model has no value */
+static inline void _no_data(sjqbn_properties_t *data) {
+    data->vp=-1;
+    data->vs=-1;
+    data->rho=-1;
+}
 
-float _interp_a_point(sjqbn_dataset_t *dataset, float *buffer, sjqbn_pt_info_t *pt) {
-    int lon_idx=pt->lon_idx;
-    int lat_idx=pt->lat_idx;
-    int dep_idx=pt->dep_idx;
+/* trilinear blend of the 8 cell corners, ordered as in _interp_a_point */
+static float _trilinear(float *val, sjqbn_pt_info_t *pt) {
     float lon_percent=pt->lon_percent;
     float lat_percent=pt->lat_percent;
     float dep_percent=pt->dep_percent;
 
-    if(pt->lon_idx < 0 || pt->lat_idx < 0 || pt->dep_idx < 0 ||
-         pt->lon_idx +1 >= dataset->nx || pt->lat_idx +1 >= dataset->ny || pt->dep_idx+1 >= dataset->nz ) {
-        // out of bound
-        return -1;
-    }
-
-    float val0= buffer[_buffer_offset(dataset,lon_idx,lat_idx,dep_idx)];      // x,    y, z
-    float val1= buffer[_buffer_offset(dataset,lon_idx+1,lat_idx,dep_idx)];    // x+1,  y, z 
-    float val2= buffer[_buffer_offset(dataset,lon_idx,lat_idx+1,dep_idx)];    // x,  y+1, z 
-    float val3= buffer[_buffer_offset(dataset,lon_idx+1,lat_idx+1,dep_idx)];  // x+1,y+1, z
-    float val4= buffer[_buffer_offset(dataset,lon_idx,lat_idx,dep_idx+1)];    // x,    y, z+1
-    float val5= buffer[_buffer_offset(dataset,lon_idx+1,lat_idx,dep_idx+1)];  // x+1,  y, z+1
-    float val6= buffer[_buffer_offset(dataset,lon_idx,lat_idx+1,dep_idx+1)];  // x,  y+1, z+1
-    float val7= buffer[_buffer_offset(dataset,lon_idx+1,lat_idx+1,dep_idx+1)];// x+1,y+1, z+1
-        
-    float val00= val0 * (1-lon_percent) + val1 * lon_percent;    
-    float val11= val4 * (1-lon_percent) + val5 * lon_percent;    
-    float val22= val2 * (1-lon_percent) + val3 * lon_percent;    
-    float val33= val6 * (1-lon_percent) + val7 * lon_percent;    
+    float val00= val[0] * (1-lon_percent) + val[1] * lon_percent;    
+    float val11= val[4] * (1-lon_percent) + val[5] * lon_percent;    
+    float val22= val[2] * (1-lon_percent) + val[3] * lon_percent;    
+    float val33= val[6] * (1-lon_percent) + val[7] * lon_percent;    
 
     float val000 = val00 * (1-lat_percent) + val22 * lat_percent;
     float val111 = val11 * (1-lat_percent) + val33 * lat_percent;
@@ -145,14 +1334,594 @@ float _interp_a_point(sjqbn_dataset_t *dataset, float *buffer, sjqbn_pt_info_t *
     return val0000;
 }
 
+static int _out_of_cell(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt) {
+    return (pt->lon_idx < 0 || pt->lat_idx < 0 || pt->dep_idx < 0 ||
+         pt->lon_idx +1 >= dataset->nx || pt->lat_idx +1 >= dataset->ny || pt->dep_idx+1 >= dataset->nz );
+}
+
+/* The cell kernels come in two index widths, chosen per dataset by
+   wide_index: 32 bit offsets whenever the stored nodes fit, which is
+   the usual case, 64 bit beyond that. The offsets are worked out in
+   that width from the start, not narrowed from _layout_offset. */
+#define SJQBN_CELL_KERNELS(W, idx_t)                                               \
+static inline idx_t _layout_offset##W(sjqbn_dataset_t *dataset, int x_idx, int y_idx, int z_idx) { \
+    if(dataset->layout == SJQBN_LAYOUT_BRICK) {                                    \
+        int shift=dataset->brick_shift;                                            \
+        int mask=(1 << shift)-1;                                                   \
+        idx_t brick= ((idx_t)(z_idx >> shift) * (idx_t)dataset->nby + (idx_t)(y_idx >> shift)) * (idx_t)dataset->nbx + (idx_t)(x_idx >> shift); \
+        idx_t inner= ((idx_t)(z_idx & mask) << (2*shift)) | (idx_t)((y_idx & mask) << shift) | (idx_t)(x_idx & mask); \
+        return (brick << (3*shift)) | inner;                                       \
+    }                                                                              \
+    return (idx_t)z_idx*(idx_t)dataset->z_stride + (idx_t)y_idx*(idx_t)dataset->y_stride + (idx_t)x_idx*(idx_t)dataset->x_stride; \
+}                                                                                  \
+                                                                                   \
+/* offsets of the 8 cell corners */                                                \
+static inline void _cell_offsets##W(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, idx_t *offsets) { \
+    int lon_idx=pt->lon_idx;                                                       \
+    int lat_idx=pt->lat_idx;                                                       \
+    int dep_idx=pt->dep_idx;                                                       \
+                                                                                   \
+    idx_t base= _layout_offset##W(dataset,lon_idx,lat_idx,dep_idx);                \
+    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nTarget offset %zu : idx lon/lat/dep = %d/%d/%d\n", (size_t)base,lon_idx,lat_idx,dep_idx); } \
+                                                                                   \
+    if(dataset->layout != SJQBN_LAYOUT_BRICK) {                                    \
+        idx_t sx=dataset->x_stride;                                                \
+        idx_t sy=dataset->y_stride;                                                \
+        idx_t sz=dataset->z_stride;                                                \
+        offsets[0]= base;             /* x,    y, z   */                           \
+        offsets[1]= base+sx;          /* x+1,  y, z   */                           \
+        offsets[2]= base+sy;          /* x,  y+1, z   */                           \
+        offsets[3]= base+sy+sx;       /* x+1,y+1, z   */                           \
+        offsets[4]= base+sz;          /* x,    y, z+1 */                           \
+        offsets[5]= base+sz+sx;       /* x+1,  y, z+1 */                           \
+        offsets[6]= base+sz+sy;       /* x,  y+1, z+1 */                           \
+        offsets[7]= base+sz+sy+sx;    /* x+1,y+1, z+1 */                           \
+        return;                                                                    \
+    }                                                                              \
+                                                                                   \
+    offsets[0]= base;                                                              \
+    offsets[1]= _layout_offset##W(dataset,lon_idx+1,lat_idx,dep_idx);              \
+    offsets[2]= _layout_offset##W(dataset,lon_idx,lat_idx+1,dep_idx);              \
+    offsets[3]= _layout_offset##W(dataset,lon_idx+1,lat_idx+1,dep_idx);            \
+    offsets[4]= _layout_offset##W(dataset,lon_idx,lat_idx,dep_idx+1);              \
+    offsets[5]= _layout_offset##W(dataset,lon_idx+1,lat_idx,dep_idx+1);            \
+    offsets[6]= _layout_offset##W(dataset,lon_idx,lat_idx+1,dep_idx+1);            \
+    offsets[7]= _layout_offset##W(dataset,lon_idx+1,lat_idx+1,dep_idx+1);          \
+}                                                                                  \
+                                                                                   \
+/* corners 0-3 sit in depth slab dep_idx, 4-7 in dep_idx+1 */                      \
+static inline float _interp_a_point##W(sjqbn_dataset_t *dataset, int prop, idx_t *offsets, sjqbn_pt_info_t *pt) { \
+    float val[8];                                                                  \
+                                                                                   \
+    for(int i=0; i<8; i++) {                                                       \
+        val[i]= _node_value(dataset, prop, offsets[i], pt->dep_idx + (i >> 2));    \
+    }                                                                              \
+    return _trilinear(val, pt);                                                    \
+}                                                                                  \
+                                                                                   \
+static void _interp_cell##W(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data) { \
+    idx_t offsets[8];                                                              \
+                                                                                   \
+    _cell_offsets##W(dataset, pt, offsets);                                        \
+    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nInterp PROCESSING for vp\n"); }     \
+    data->vp = _interp_a_point##W(dataset, SJQBN_VP_IDX, offsets, pt);             \
+    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nInterp PROCESSING for vs\n"); }     \
+    data->vs = _interp_a_point##W(dataset, SJQBN_VS_IDX, offsets, pt);             \
+    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nInterp PROCESSING for rho\n"); }    \
+    data->rho = _interp_a_point##W(dataset, SJQBN_RHO_IDX, offsets, pt);           \
+}
+
+SJQBN_CELL_KERNELS(32, uint32_t)
+SJQBN_CELL_KERNELS(64, size_t)
+
+/**** storage backends ****/
+/* dense, through the interface; the queries inline these instead */
+static int _dense_node(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float *val) {
+    size_t offset=_layout_offset(dataset, pt->lon_idx, pt->lat_idx, pt->dep_idx);
+
+    for(int p=0; p<SJQBN_PROP_CNT; p++) val[p]=_node_value(dataset, p, offset, pt->dep_idx);
+    return SUCCESS;
+}
+
+static int _dense_corners(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float (*val)[8]) {
+    size_t offsets[8];
+
+    _cell_offsets64(dataset, pt, offsets);
+    for(int p=0; p<SJQBN_PROP_CNT; p++) {
+        for(int i=0; i<8; i++) val[p][i]=_node_value(dataset, p, offsets[i], pt->dep_idx + (i >> 2));
+    }
+    return SUCCESS;
+}
+
+/* lazy: dense once the slabs are in */
+static int _lazy_node(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float *val) {
+    if(_ensure_slabs(dataset, pt->dep_idx, pt->dep_idx) != SUCCESS) return FAIL;
+    return _dense_node(dataset, pt, val);
+}
+
+static int _lazy_corners(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float (*val)[8]) {
+    if(_ensure_slabs(dataset, pt->dep_idx, pt->dep_idx+1) != SUCCESS) return FAIL;
+    return _dense_corners(dataset, pt, val);
+}
+
+/* tiled: one cache lookup per node for all three properties, a batch
+   takes the cache lock once */
+static inline size_t _corner_offset(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, int i) {
+    return _layout_offset(dataset, pt->lon_idx + (i & 1), pt->lat_idx + ((i >> 1) & 1), pt->dep_idx + (i >> 2));
+}
+
+static int _tiled_node(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float *val) {
+    return sjqbn_tile_values(dataset->tiles, _layout_offset(dataset, pt->lon_idx, pt->lat_idx, pt->dep_idx), val);
+}
+
+static int _tiled_corners(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float (*val)[8]) {
+    float node[SJQBN_PROP_CNT];
+
+    for(int i=0; i<8; i++) {
+        if(sjqbn_tile_values(dataset->tiles, _corner_offset(dataset, pt, i), node) != SUCCESS) return FAIL;
+        for(int p=0; p<SJQBN_PROP_CNT; p++) val[p][i]=node[p];
+    }
+    return SUCCESS;
+}
+
+/* batch fetches over a store that looks up n node offsets at a time */
+typedef void (*_values_n_fn)(void *store, size_t *offsets, int n, float *out, int *rc);
+
+static void _batch_nodes(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT], int *rc,
+          _values_n_fn values_n, void *store) {
+    size_t offsets[SJQBN_FETCH_BATCH];
+    int m=0;
+
+    for(int k=0; k<n; k++) {
+        if(pts[k].lon_idx >= 0) offsets[m++]=_layout_offset(dataset, pts[k].lon_idx, pts[k].lat_idx, pts[k].dep_idx);
+    }
+    values_n(store, offsets, m, &val[0][0], rc);
+    // spread back out over the skipped points
+    for(int k=n-1; k>=0; k--) {
+        if(pts[k].lon_idx < 0) continue;
+        m--;
+        rc[k]=rc[m];
+        for(int p=0; p<SJQBN_PROP_CNT; p++) val[k][p]=val[m][p];
+    }
+}
+
+static void _batch_corner_sets(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT][8], int *rc,
+          _values_n_fn values_n, void *store) {
+    size_t offsets[SJQBN_FETCH_BATCH*8];
+    float node[SJQBN_FETCH_BATCH*8][SJQBN_PROP_CNT];
+    int node_rc[SJQBN_FETCH_BATCH*8];
+    int m=0;
+
+    for(int k=0; k<n; k++) {
+        if(pts[k].lon_idx < 0) continue;
+        for(int i=0; i<8; i++) offsets[m++]=_corner_offset(dataset, &pts[k], i);
+    }
+    values_n(store, offsets, m, &node[0][0], node_rc);
+    m=0;
+    for(int k=0; k<n; k++) {
+        if(pts[k].lon_idx < 0) continue;
+        rc[k]=SUCCESS;
+        for(int i=0; i<8; i++, m++) {
+            if(node_rc[m] != SUCCESS) rc[k]=FAIL;
+            for(int p=0; p<SJQBN_PROP_CNT; p++) val[k][p][i]=node[m][p];
+        }
+    }
+}
+
+static void _tile_values_n(void *store, size_t *offsets, int n, float *out, int *rc) {
+    sjqbn_tile_values_n((sjqbn_tile_cache_t *)store, offsets, n, out, rc);
+}
+
+static void _tiled_nodes(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT], int *rc) {
+    _batch_nodes(dataset, pts, n, val, rc, _tile_values_n, dataset->tiles);
+}
+
+static void _tiled_corner_sets(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT][8], int *rc) {
+    _batch_corner_sets(dataset, pts, n, val, rc, _tile_values_n, dataset->tiles);
+}
+
+/* disk: every fetch is one submission, the 8 corners of a single cell too */
+static void _disk_values_n(void *store, size_t *offsets, int n, float *out, int *rc) {
+    sjqbn_disk_values_n((sjqbn_disk_t *)store, offsets, n, out, rc, NULL, NULL);
+}
+
+static int _disk_node(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float *val) {
+    size_t offset=_layout_offset(dataset, pt->lon_idx, pt->lat_idx, pt->dep_idx);
+    int rc;
+
+    sjqbn_disk_values_n(dataset->disk, &offset, 1, val, &rc, NULL, NULL);
+    return rc;
+}
+
+static int _disk_corners(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float (*val)[8]) {
+    float vals[1][SJQBN_PROP_CNT][8];
+    int rc;
+
+    _batch_corner_sets(dataset, pt, 1, vals, &rc, _disk_values_n, dataset->disk);
+    memcpy(val, vals[0], sizeof(vals[0]));
+    return rc;
+}
+
+static void _disk_nodes(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT], int *rc) {
+    _batch_nodes(dataset, pts, n, val, rc, _disk_values_n, dataset->disk);
+}
+
+static void _disk_corner_sets(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, float (*val)[SJQBN_PROP_CNT][8], int *rc) {
+    _batch_corner_sets(dataset, pts, n, val, rc, _disk_values_n, dataset->disk);
+}
+
+/* a batch of cells being interpolated as their corners are read, the
+   8 nodes of the r'th cell at 8*r in node */
+typedef struct _disk_cells_t {
+    sjqbn_pt_info_t *pts;
+    sjqbn_properties_t *out;
+    int pt[SJQBN_FETCH_BATCH];      /* point of each cell */
+    int left[SJQBN_FETCH_BATCH];    /* corners still out */
+    float node[SJQBN_FETCH_BATCH*8][SJQBN_PROP_CNT];
+    int node_rc[SJQBN_FETCH_BATCH*8];
+} _disk_cells_t;
+
+static void _disk_corner_in(void *arg, int idx) {
+    _disk_cells_t *cells=(_disk_cells_t *)arg;
+    int r=idx / 8;
+    float val[SJQBN_PROP_CNT][8];
+
+    if(--cells->left[r] > 0) return;
+    sjqbn_pt_info_t *pt=&cells->pts[cells->pt[r]];
+    sjqbn_properties_t *out=&cells->out[cells->pt[r]];
+    for(int i=0; i<8; i++) {
+        if(cells->node_rc[8*r+i] != SUCCESS) {
+            _no_data(out);
+            return;
+        }
+        for(int p=0; p<SJQBN_PROP_CNT; p++) val[p][i]=cells->node[8*r+i][p];
+    }
+    out->vp = _trilinear(val[SJQBN_VP_IDX], pt);
+    out->vs = _trilinear(val[SJQBN_VS_IDX], pt);
+    out->rho = _trilinear(val[SJQBN_RHO_IDX], pt);
+}
+
+static void _disk_interp(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, sjqbn_properties_t *out) {
+    _disk_cells_t cells;
+    size_t offsets[SJQBN_FETCH_BATCH*8];
+    int m=0;
+
+    cells.pts=pts;
+    cells.out=out;
+    for(int k=0; k<n; k++) {
+        if(pts[k].lon_idx < 0) continue;
+        for(int i=0; i<8; i++) offsets[8*m+i]=_corner_offset(dataset, &pts[k], i);
+        cells.pt[m]=k;
+        cells.left[m++]=8;
+    }
+    sjqbn_disk_values_n(dataset->disk, offsets, 8*m, &cells.node[0][0], cells.node_rc, _disk_corner_in, &cells);
+}
+
+/* rle: one run search per column, the node below is the same run or the next */
+static int _rle_node(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float *val) {
+    sjqbn_rle_t *rle=dataset->rle;
+    size_t col=(size_t)pt->lat_idx * rle->nx + pt->lon_idx;
+    float *rec=rle->run_val + (size_t)sjqbn_rle_run(rle, col, pt->dep_idx) * SJQBN_PROP_CNT;
+
+    for(int p=0; p<SJQBN_PROP_CNT; p++) val[p]=rec[p];
+    return SUCCESS;
+}
+
+static int _rle_corners(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, float (*val)[8]) {
+    sjqbn_rle_t *rle=dataset->rle;
+
+    for(int i=0; i<4; i++) {
+        size_t col=(size_t)(pt->lat_idx + (i >> 1)) * rle->nx + pt->lon_idx + (i & 1);
+        uint32_t top=sjqbn_rle_run(rle, col, pt->dep_idx);
+        uint32_t bottom=sjqbn_rle_next(rle, col, top, pt->dep_idx);
+        for(int p=0; p<SJQBN_PROP_CNT; p++) {
+            val[p][i]=rle->run_val[(size_t)top*SJQBN_PROP_CNT+p];
+            val[p][i+4]=rle->run_val[(size_t)bottom*SJQBN_PROP_CNT+p];
+        }
+    }
+    return SUCCESS;
+}
+
+const sjqbn_backend_t sjqbn_dense_backend={
+    .name="dense", .load=_load_dense,
+    .fetch_node=_dense_node, .fetch_corners=_dense_corners
+};
+const sjqbn_backend_t sjqbn_lazy_backend={
+    .name="lazy", .load=_load_lazy,
+    .fetch_node=_lazy_node, .fetch_corners=_lazy_corners
+};
+const sjqbn_backend_t sjqbn_tiled_backend={
+    .name="tiled", .load=_load_tiled,
+    .fetch_node=_tiled_node, .fetch_corners=_tiled_corners,
+    .fetch_nodes=_tiled_nodes, .fetch_corner_sets=_tiled_corner_sets
+};
+const sjqbn_backend_t sjqbn_disk_backend={
+    .name="disk", .load=_load_disk, .release=_release_disk,
+    .fetch_node=_disk_node, .fetch_corners=_disk_corners,
+    .fetch_nodes=_disk_nodes, .fetch_corner_sets=_disk_corner_sets,
+    .fetch_interp=_disk_interp
+};
+const sjqbn_backend_t sjqbn_rle_backend={
+    .name="rle", .load=_load_rle,
+    .fetch_node=_rle_node, .fetch_corners=_rle_corners
+};
+
+/**** residency ****/
+/* property volumes of the dense storage, with their bytes per node */
+static int _dense_volumes(sjqbn_dataset_t *data, char **base, size_t *size) {
+    void *vol[]={ data->records, data->packed_records,
+                  data->packed[SJQBN_VP_IDX], data->packed[SJQBN_VS_IDX], data->packed[SJQBN_RHO_IDX],
+                  data->vp_buffer, data->vs_buffer, data->rho_buffer };
+    size_t bytes[]={ SJQBN_PROP_CNT * sizeof(float), SJQBN_PROP_CNT * sizeof(uint16_t),
+                     sizeof(uint16_t), sizeof(uint16_t), sizeof(uint16_t),
+                     sizeof(float), sizeof(float), sizeof(float) };
+    int n=0;
+
+    for(int v=0; v<8; v++) {
+        if(vol[v] == NULL) continue;
+        base[n]=vol[v];
+        size[n++]=bytes[v];
+    }
+    return n;
+}
+
+/* lock the nodes from the surface down to pin_depth and the slab below
+   it, so cells reaching down to pin_depth stay in memory too */
+static void _pin_hot_region(sjqbn_dataset_t *data, float pin_depth) {
+    char *base[8];
+    size_t size[8];
+    int nvol=_dense_volumes(data, base, size);
+    int zc=0;
+
+    while(zc < data->nz && data->depths[zc] <= pin_depth) zc++;
+    if(zc < data->nz) zc++;
+
+    for(int v=0; v<nvol; v++) {
+        if(data->layout != SJQBN_LAYOUT_COLUMN) {
+            // slabs, or rows of bricks, from the top are a prefix of the volume
+            size_t nodes=(size_t)zc * data->z_stride;
+            if(data->layout == SJQBN_LAYOUT_BRICK) {
+                int shift=data->brick_shift;
+                nodes=((size_t)((zc + (1 << shift)-1) >> shift) * data->nby * data->nbx) << (3*shift);
+            }
+            data->pinned_bytes+=sjqbn_resident_pin(base[v], nodes * size[v]);
+            continue;
+        }
+        // top of every column, columns closer than a page go in one range
+        char *lo=NULL, *hi=NULL;
+        for(size_t c=0; c<(size_t)data->nx * data->ny; c++) {
+            char *top=base[v] + c * data->nz * size[v];
+            if(lo != NULL && top <= hi + SJQBN_SMALL_PAGE) {
+                hi=top + zc * size[v];
+                continue;
+            }
+            if(lo != NULL) data->pinned_bytes+=sjqbn_resident_pin(lo, hi - lo);
+            lo=top;
+            hi=top + zc * size[v];
+        }
+        if(lo != NULL) data->pinned_bytes+=sjqbn_resident_pin(lo, hi - lo);
+    }
+    if(sjqbn_ucvm_debug) fprintf(stderrfp," pinned %d depth slabs, %zu bytes\n", zc, data->pinned_bytes);
+}
+
+/* the coordinate lists are final once the storage is, wherever it came from */
+static void _setup_axes(sjqbn_dataset_t *data) {
+    static const char *names[3]={"longitude", "latitude", "depth"};
+    float *values[3]={data->longitudes, data->latitudes, data->depths};
+    int n[3]={data->nx, data->ny, data->nz};
+
+    for(int a=0; a<3; a++) {
+        sjqbn_axis_t *axis=&data->axes[a];
+        if(setup_sjqbn_axis(axis, values[a], n[a]) != SUCCESS) {
+            fprintf(stderr, "axes: malloc failed\n");
+        }
+        if(sjqbn_ucvm_debug) {
+            if(axis->uniform) {
+                fprintf(stderrfp," %s axis uniform\n", names[a]);
+                } else if(axis->lut != NULL) {
+                    fprintf(stderrfp," %s axis table of %d buckets\n", names[a], axis->lut_cnt);
+                } else {
+                    fprintf(stderrfp," %s axis searched in Eytzinger order\n", names[a]);
+            }
+        }
+    }
+}
+
+/* dense storage: read ahead per batch on a mapped image, pin the hot region */
+static void _setup_residency(sjqbn_dataset_t *data, sjqbn_configuration_t *config) {
+    data->prefetch=(config->prefetch && data->cache_map != NULL);
+    if(config->pin_depth > 0) _pin_hot_region(data, config->pin_depth);
+}
+
+/* advise the pages holding the nodes, and validity bits, the batch
+   reads; they go to the kernel a window of points at a time, all
+   before the first is read */
+static void _prefetch_points(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, int interp) {
+    uintptr_t pages[SJQBN_FETCH_BATCH * (8 * SJQBN_PROP_CNT + 1)];
+    char *base[8];
+    size_t size[8];
+    int nvol=_dense_volumes(dataset, base, size);
+    uint64_t *valid=interp ? dataset->cell_valid : dataset->node_valid;
+    int corners=interp ? 8 : 1;
+    int window=(sizeof(pages) / sizeof(pages[0])) / (corners * nvol + 1);
+    uintptr_t mask=~((uintptr_t)SJQBN_SMALL_PAGE-1);
+
+    for(int i0=0; i0<n; i0+=window) {
+        int m=0;
+        for(int i=i0; i<n && i<i0+window; i++) {
+            sjqbn_pt_info_t *pt=&pts[i];
+            if(pt->lon_idx < 0 || pt->lat_idx < 0 || pt->dep_idx < 0) continue;
+            if(interp && _out_of_cell(dataset, pt)) continue;
+            if(valid != NULL) {
+                size_t bit=((size_t)pt->dep_idx * dataset->ny + pt->lat_idx) * dataset->nx + pt->lon_idx;
+                pages[m++]=(uintptr_t)&valid[bit >> 6] & mask;
+            }
+            for(int c=0; c<corners; c++) {
+                size_t offset=_corner_offset(dataset, pt, c);
+                for(int v=0; v<nvol; v++) pages[m++]=(uintptr_t)(base[v] + offset * size[v]) & mask;
+            }
+        }
+        sjqbn_resident_advise(pages, m);
+    }
+}
+
+/* outside the region of interest the dataset was loaded for */
+int outside_sjqbn_roi(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt) {
+    return (pt->lon < dataset->roi[SJQBN_ROI_LON][0] || pt->lon > dataset->roi[SJQBN_ROI_LON][1] ||
+            pt->lat < dataset->roi[SJQBN_ROI_LAT][0] || pt->lat > dataset->roi[SJQBN_ROI_LAT][1] ||
+            pt->dep < dataset->roi[SJQBN_ROI_DEPTH][0] || pt->dep > dataset->roi[SJQBN_ROI_DEPTH][1]);
+}
+
+/* the node is in the grid and has all properties, else the point
+   gets the no data markers */
+static inline int _node_usable(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data) {
+    if(pt->lon_idx < 0 || pt->lat_idx < 0 || pt->dep_idx < 0 ||
+              (dataset->node_valid != NULL &&
+               !_valid_bit(dataset->node_valid, ((size_t)pt->dep_idx * dataset->ny + pt->lat_idx) * dataset->nx + pt->lon_idx))) {
+        _no_data(data);
+        return 0;
+    }
+    return 1;
+}
+
+/* same for all 8 corners of the cell */
+static inline int _cell_usable(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data) {
+    if(_out_of_cell(dataset, pt) ||
+              (dataset->cell_valid != NULL &&
+               !_valid_bit(dataset->cell_valid, ((size_t)pt->dep_idx * dataset->ny + pt->lat_idx) * dataset->nx + pt->lon_idx))) {
+        _no_data(data);
+        return 0;
+    }
+    return 1;
+}
+
+int64_t get_one_property(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data) {
+    if(!_node_usable(dataset, pt, data)) return -1;
+
+    size_t offset= _buffer_offset(dataset, pt->lon_idx, pt->lat_idx, pt->dep_idx);
+
+    if(dataset->backend == NULL) {
+        data->vp=_node_value(dataset, SJQBN_VP_IDX, offset, pt->dep_idx);
+        data->vs=_node_value(dataset, SJQBN_VS_IDX, offset, pt->dep_idx);
+        data->rho=_node_value(dataset, SJQBN_RHO_IDX, offset, pt->dep_idx);
+        return offset;
+    }
+
+    float val[SJQBN_PROP_CNT];
+    if(dataset->backend->fetch_node(dataset, pt, val) != SUCCESS) {
+        _no_data(data);
+        return offset;
+    }
+    data->vp=val[SJQBN_VP_IDX];
+    data->vs=val[SJQBN_VS_IDX];
+    data->rho=val[SJQBN_RHO_IDX];
+    return offset;
+}
+
 void get_interp_property(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data) {
+    // out of bound, or a corner is missing
+    if(!_cell_usable(dataset, pt, data)) return;
+
+    if(dataset->backend == NULL) {
+        if(dataset->wide_index) {
+            _interp_cell64(dataset, pt, data);
+            } else {
+                _interp_cell32(dataset, pt, data);
+        }
+        return;
+    }
 
-    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nInterp PROCESSING for vp\n"); }
-    data->vp = _interp_a_point(dataset, dataset->vp_buffer, pt);
-    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nInterp PROCESSING for vs\n"); }
-    data->vs = _interp_a_point(dataset, dataset->vs_buffer, pt);
-    if(sjqbn_ucvm_debug) { fprintf(stderrfp,"\nInterp PROCESSING for rho\n"); }
-    data->rho = _interp_a_point(dataset, dataset->rho_buffer, pt);
-    return;
+    float val[SJQBN_PROP_CNT][8];
+    if(dataset->backend->fetch_corners(dataset, pt, val) != SUCCESS) {
+        _no_data(data);
+        return;
+    }
+    data->vp = _trilinear(val[SJQBN_VP_IDX], pt);
+    data->vs = _trilinear(val[SJQBN_VS_IDX], pt);
+    data->rho = _trilinear(val[SJQBN_RHO_IDX], pt);
 }
 
+/* dense storage and backends without batch fetches go point by point;
+   otherwise the points go to the backend SJQBN_FETCH_BATCH at a time,
+   the ones the engine answers itself (outside the grid, no data)
+   marked with lon_idx -1, and interpolated by the backend when it
+   has fetch_interp */
+static void _query_points(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, sjqbn_properties_t *data, int interp) {
+    const sjqbn_backend_t *backend=dataset->backend;
+    float corners[SJQBN_FETCH_BATCH][SJQBN_PROP_CNT][8];
+    float node[SJQBN_FETCH_BATCH][SJQBN_PROP_CNT];
+    int rc[SJQBN_FETCH_BATCH];
+
+    if(backend == NULL || (interp && backend->fetch_corner_sets == NULL) || (!interp && backend->fetch_nodes == NULL)) {
+        for(int i=0; i<n; i++) {
+            if(interp) {
+                get_interp_property(dataset, &pts[i], &data[i]);
+                } else {
+                    get_one_property(dataset, &pts[i], &data[i]);
+            }
+        }
+        return;
+    }
+
+    for(int i0=0; i0<n; i0+=SJQBN_FETCH_BATCH) {
+        int m=(n - i0 < SJQBN_FETCH_BATCH) ? n - i0 : SJQBN_FETCH_BATCH;
+        sjqbn_pt_info_t *blk=pts + i0;
+        sjqbn_properties_t *out=data + i0;
+
+        for(int k=0; k<m; k++) {
+            if(!(interp ? _cell_usable(dataset, &blk[k], &out[k]) : _node_usable(dataset, &blk[k], &out[k]))) {
+                blk[k].lon_idx=-1;
+            }
+        }
+        if(interp && backend->fetch_interp != NULL) {
+            backend->fetch_interp(dataset, blk, m, out);
+            continue;
+        }
+        if(interp) {
+            backend->fetch_corner_sets(dataset, blk, m, corners, rc);
+            } else {
+                backend->fetch_nodes(dataset, blk, m, node, rc);
+        }
+        for(int k=0; k<m; k++) {
+            if(blk[k].lon_idx < 0) continue;
+            if(rc[k] != SUCCESS) {
+                _no_data(&out[k]);
+                } else if(interp) {
+                    out[k].vp = _trilinear(corners[k][SJQBN_VP_IDX], &blk[k]);
+                    out[k].vs = _trilinear(corners[k][SJQBN_VS_IDX], &blk[k]);
+                    out[k].rho = _trilinear(corners[k][SJQBN_RHO_IDX], &blk[k]);
+                } else {
+                    out[k].vp=node[k][SJQBN_VP_IDX];
+                    out[k].vs=node[k][SJQBN_VS_IDX];
+                    out[k].rho=node[k][SJQBN_RHO_IDX];
+            }
+        }
+    }
+}
+
+/**
+ * Answers a set of located points as one batch. With prefetch its
+ * pages are advised before any is read, with fault_stats the page
+ * faults it took are counted, a replica's on the dataset it copies.
+ *
+ * @param interp trilinear (1) or nearest lower node (0)
+ */
+void query_sjqbn_points(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, sjqbn_properties_t *data, int interp) {
+    long major0=0, minor0=0, major1, minor1;
+
+    if(dataset->fault_stats) sjqbn_resident_faults(&major0, &minor0);
+    if(dataset->prefetch) _prefetch_points(dataset, pts, n, interp);
+
+    _query_points(dataset, pts, n, data, interp);
+
+    if(dataset->fault_stats) {
+        sjqbn_dataset_t *stats=(dataset->replica_of != NULL) ? dataset->replica_of : dataset;
+        sjqbn_resident_faults(&major1, &minor1);
+        __atomic_add_fetch(&stats->batches, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->major_faults, major1 - major0, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->minor_faults, minor1 - minor0, __ATOMIC_RELAXED);
+        if(sjqbn_ucvm_debug) {
+            fprintf(stderrfp," batch of %d points: %ld major %ld minor page faults\n", n, major1 - major0, minor1 - minor0);
+        }
+    }
+}
@@ -6,9 +6,60 @@
 #ifndef SJQBN_UTIL_H
 #define SJQBN_UTIL_H
 
+#include <stdint.h>
+#include <pthread.h>
+#include "sjqbn_numa.h"
+#include "sjqbn_axis.h"
+
 #define SJQBN_DATASET_MAX 10
 
 typedef struct sjqbn_properties_t sjqbn_properties_t;
+typedef struct sjqbn_configuration_t sjqbn_configuration_t;
+
+/* property slots, also the order within an interleaved record */
+#define SJQBN_VP_IDX 0
+#define SJQBN_VS_IDX 1
+#define SJQBN_RHO_IDX 2
+#define SJQBN_PROP_CNT 3
+
+/* in-memory node orderings */
+#define SJQBN_LAYOUT_SLAB 0   /* depth, lat, lon as in the netCDF file */
+#define SJQBN_LAYOUT_BRICK 1  /* brick_size^3 bricks, each stored contiguously */
+#define SJQBN_LAYOUT_COLUMN 2 /* lat, lon, depth, each depth column contiguous */
+
+#define SJQBN_BRICK_SIZE 8
+
+#define SJQBN_SMALL_PAGE 4096
+#define SJQBN_HUGE_PAGE (2*1024*1024)
+
+/* element precision of the stored volumes */
+#define SJQBN_PRECISION_FLOAT 0
+#define SJQBN_PRECISION_HALF 1    /* IEEE binary16 */
+#define SJQBN_PRECISION_FIXED16 2 /* uint16 with a scale/base per depth slab */
+
+/* axes of the region of interest bounds */
+#define SJQBN_ROI_LON 0
+#define SJQBN_ROI_LAT 1
+#define SJQBN_ROI_DEPTH 2
+
+/* init phases timed by the loader */
+#define SJQBN_PHASE_AXES 0
+#define SJQBN_PHASE_VOLUMES 1
+#define SJQBN_PHASE_PACK 2
+#define SJQBN_PHASE_CNT 3
+
+#define SJQBN_LOAD_THREADS_MAX 16
+/* most a variable's chunk cache may take */
+#define SJQBN_CHUNK_CACHE_MAX (256*1024*1024)
+
+/* fill/missing values looked for per property variable */
+#define SJQBN_FILL_MAX 4
+
+/* where the property values come from at query time */
+#define SJQBN_ACCESS_MEMORY 0 /* whole volumes loaded at init */
+#define SJQBN_ACCESS_TILED 1  /* tiles read from the netCDF file on demand */
+#define SJQBN_ACCESS_AUTO 2   /* one of the above, picked at init from the memory budget */
+#define SJQBN_ACCESS_DISK 3   /* each query batch read from a tiled image in one submission */
 
 /** The SJQBN a dataset's working structure. */
 typedef struct sjqbn_dataset_t {
@@ -22,22 +73,132 @@ typedef struct sjqbn_dataset_t {
 	/** Number of z(dep) points */
 	int nz;
 
+/* region of interest: the grid above is the file's nodes from
+   x0/y0/z0 on, selected by the bounds in roi */
+        int x0;
+        int y0;
+        int z0;
+        float roi[3][2];
+
 	/** list of longitudes **/
 	float *longitudes;
 	/** list of latitudes **/
 	float *latitudes;
 	/** list of depths **/
 	float *depths;
+/* cell lookup along each, indexed by SJQBN_ROI_LON/LAT/DEPTH */
+        sjqbn_axis_t axes[3];
 
 	int vp_varid;
 	int vs_varid;
 	int rho_varid;
 
-	int elems;
+	size_t elems;
+
+/* node ordering of the buffers and records below */
+        int layout;
+        size_t x_stride;  /* node strides of slab and column layouts */
+        size_t y_stride;
+        size_t z_stride;
+        int brick_shift;  /* log2 of brick edge */
+        int nbx;          /* bricks along lon */
+        int nby;          /* bricks along lat */
+        size_t store_elems; /* nodes allocated, includes brick padding */
+        int wide_index;     /* store_elems needs 64 bit offsets */
+
 	float *vp_buffer;
 	float *vs_buffer;
 	float *rho_buffer; 
 
+/* interleaved vp/vs/rho records, one per grid node, replaces the
+   3 buffers above when in use */
+        int interleaved;
+        float *records;
+
+/* 16 bit storage, replaces the float buffers/records above when in use */
+        int precision;
+        uint16_t *packed[SJQBN_PROP_CNT];
+        uint16_t *packed_records;
+        float *slab_base;    /* fixed16, indexed [prop*nz + z] */
+        float *slab_scale;
+        float quant_error[SJQBN_PROP_CNT]; /* max |stored - float| at load */
+
+/* page backing of the volumes, see alloc_sjqbn_volume */
+        int huge_pages;       /* 2MB pages asked for */
+        int hugetlb_volumes;  /* volumes that got them */
+        int thp_volumes;      /* volumes advised for transparent huge pages */
+        int small_volumes;    /* volumes on base pages */
+
+/* NUMA placement of the volumes, see sjqbn_numa.c */
+        int numa_policy;
+        int numa_nodes;
+        int numa_node;        /* node the volumes are bound to, -1 if none */
+        struct sjqbn_dataset_t *replicas[SJQBN_NUMA_MAX]; /* per node copies, [0] is this one */
+        struct sjqbn_dataset_t *replica_of;
+
+/* read-only image all the arrays above point into, see sjqbn_cache.c */
+        void *cache_map;
+        size_t cache_map_len;
+/* node-wide shared segment the image lives in, empty name if none */
+        char shm_name[64];
+        int shm_fd;
+
+/* residency of the dense storage, see sjqbn_resident.c */
+        int prefetch;         /* advise each batch's pages first, mapped images only */
+        int fault_stats;      /* count the page faults of each batch */
+        size_t pinned_bytes;  /* locked from the surface down to pin_depth */
+        long batches;         /* with the faults below, summed over the replicas */
+        long major_faults;
+        long minor_faults;
+
+/* NODATA bitmaps, bit (z*ny+y)*nx+x whatever the layout, NULL when
+   every node has all of vp/vs/rho: node_valid is the node's own,
+   cell_valid that of all 8 corners of the cell it is the first of */
+        uint64_t *node_valid;
+        uint64_t *cell_valid;
+        size_t invalid_nodes;
+
+/* lazy mode: slab layout float volumes reserved at init, depth slab z
+   read from netCDF by the first query that needs it */
+        int lazy;
+        unsigned char *slab_ready;  /* [z], set once all 3 properties are in */
+        pthread_mutex_t slab_lock;
+        int slabs_loaded;
+/* async mode: a background thread fills the lazy slabs top down */
+        int async;
+        int fill_started;
+        int fill_stop;
+        int fill_done;      /* under slab_lock, signalled on fill_cond */
+        int fill_rc;
+        pthread_t filler;
+        pthread_cond_t fill_cond;
+
+/* storage backend queries fetch through, NULL for the dense storage
+   above, see sjqbn_backend.h; backend_state is for registered ones */
+        const struct sjqbn_backend_t *backend;
+        void *backend_state;
+
+/* disk resident tiles, replaces all the storage above when in use,
+   see sjqbn_tiles.c */
+        struct sjqbn_tile_cache_t *tiles;
+
+/* tiled image read per query batch, replaces all the storage above
+   when in use, see sjqbn_disk.c */
+        struct sjqbn_disk_t *disk;
+
+/* run-length encoded depth columns, replaces the float volumes when in
+   use, see sjqbn_rle.c */
+        struct sjqbn_rle_t *rle;
+
+/* on-disk chunking of the property variables, chunks[] is the largest
+   along each axis, 1/ny/nx shaped when contiguous */
+        int chunked;
+        int deflated;
+        size_t chunks[3];   /* depth, lat, lon as in the file */
+
+/* wall clock seconds of each load phase, 0 when not loaded from netCDF */
+        double load_seconds[SJQBN_PHASE_CNT];
+
 /* flag to show if data i read in memory */
         int in_memory;
 
@@ -57,11 +218,19 @@ typedef struct sjqbn_pt_info_t {
 
 
 /* utilitie functions */
-sjqbn_dataset_t *make_a_sjqbn_dataset(char *datadir, char *datafile, int tooBig);
+sjqbn_dataset_t *make_a_sjqbn_dataset(sjqbn_configuration_t *config, char *datadir, char *datafile, int tooBig);
 int free_sjqbn_dataset(sjqbn_dataset_t *data);
-
-int get_one_property(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data);
+sjqbn_dataset_t *get_local_sjqbn_dataset(sjqbn_dataset_t *data);
+void *alloc_sjqbn_volume(sjqbn_dataset_t *data, size_t bytes);
+void free_sjqbn_volume(sjqbn_dataset_t *data, void *ptr, size_t bytes);
+void setup_sjqbn_layout(sjqbn_dataset_t *data, int layout, int brick_size);
+void start_sjqbn_dataset_fill(sjqbn_dataset_t *data);
+int wait_sjqbn_dataset_fill(sjqbn_dataset_t *data);
+
+int outside_sjqbn_roi(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt);
+int64_t get_one_property(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data);
 void get_interp_property(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pt, sjqbn_properties_t *data);
+void query_sjqbn_points(sjqbn_dataset_t *dataset, sjqbn_pt_info_t *pts, int n, sjqbn_properties_t *data, int interp);
 
 #endif
 
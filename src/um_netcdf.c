@@ -341,7 +341,6 @@ cleanup:
     return buffer;
 }
 
-
 float *get_binary_float_buffer(const char *datadir, char *datafile, int total) {
 
     int elem_size = sizeof(float);
@@ -495,3 +494,81 @@ int cache_latlon_layer_float(int ncid, int varid,
     return NC_NOERR;
 }
 
+// tile = depth, lat, lon box, start/count as netCDF hyperslab
+int cache_tile_float(int ncid, int varid,
+                const size_t *start, const size_t *count,
+                float *tile /* size >= count[0]*count[1]*count[2] */)
+{
+    int status = nc_get_vara_float(ncid, varid, start, count, tile);
+
+    if (status != NC_NOERR) {
+        fprintf(stderr, "netCDF error (cache_tile_float): %s\n", nc_strerror(status));
+        return status;
+    }
+    return NC_NOERR;
+}
+
+// chunk shape of a variable, returns 0 when it is stored contiguously
+// (always so for classic format files)
+int get_nc_chunking(int ncid, int varid, size_t *chunks, int *deflated)
+{
+    int storage = NC_CONTIGUOUS;
+    int shuffle = 0, deflate = 0, level = 0;
+
+    *deflated = 0;
+    if (nc_inq_var_chunking(ncid, varid, &storage, chunks) != NC_NOERR || storage != NC_CHUNKED) {
+        return 0;
+    }
+    if (nc_inq_var_deflate(ncid, varid, &shuffle, &deflate, &level) == NC_NOERR) {
+        *deflated = deflate;
+    }
+    return 1;
+}
+
+// size a variable's chunk cache to hold every chunk that one layer of
+// chunks over an ny x nx window touches, so reads that walk down in
+// depth decompress each chunk once
+int set_nc_layer_chunk_cache(int ncid, int varid, const size_t *chunks,
+                size_t ny, size_t nx, size_t max_bytes)
+{
+    // window may start mid chunk, so one more each way
+    size_t nchunks = (ny / chunks[1] + 2) * (nx / chunks[2] + 2);
+    size_t bytes = nchunks * chunks[0] * chunks[1] * chunks[2] * sizeof(float);
+    size_t slots = 2 * nchunks + 1;
+
+    if (bytes > max_bytes) bytes = max_bytes;
+    // hash table size, wants to be prime
+    for (size_t d = 3; d * d <= slots; d += 2) {
+        if (slots % d == 0) { slots += 2; d = 1; }
+    }
+
+    int status = nc_set_var_chunk_cache(ncid, varid, bytes, slots, 0.75f);
+    if (status != NC_NOERR) {
+        fprintf(stderr, "netCDF error (set_nc_layer_chunk_cache): %s\n", nc_strerror(status));
+    }
+    return status;
+}
+
+// values that mark a variable's missing nodes: its _FillValue (the
+// library default fill when it has none, for never written nodes) and
+// each missing_value, returns how many went into fills
+int get_nc_fill_values(int ncid, int varid, float *fills, int max)
+{
+    nc_type atype;
+    size_t alen;
+    int n = 0;
+
+    if (nc_inq_att(ncid, varid, "_FillValue", &atype, &alen) == NC_NOERR && alen == 1) {
+        if (nc_get_att_float(ncid, varid, "_FillValue", &fills[n]) == NC_NOERR) n++;
+    } else if (n < max) {
+        fills[n++] = NC_FILL_FLOAT;
+    }
+    if (nc_inq_att(ncid, varid, "missing_value", &atype, &alen) == NC_NOERR && alen > 0) {
+        float *vals = (float *)malloc(alen * sizeof(float));
+        if (vals != NULL && nc_get_att_float(ncid, varid, "missing_value", vals) == NC_NOERR) {
+            for (size_t i = 0; i < alen && n < max; i++) fills[n++] = vals[i];
+        }
+        free(vals);
+    }
+    return n;
+}
@@ -42,6 +42,15 @@ int cache_latlon_layer_float(int ncid, int varid,
                 size_t dep_idx, size_t ny, size_t nx,
                 float *layer /* size >= ny*nx */);
 
+int cache_tile_float(int ncid, int varid,
+                const size_t *start, const size_t *count,
+                float *tile /* size >= count[0]*count[1]*count[2] */);
+
+int get_nc_chunking(int ncid, int varid, size_t *chunks, int *deflated);
+int set_nc_layer_chunk_cache(int ncid, int varid, const size_t *chunks,
+                size_t ny, size_t nx, size_t max_bytes);
+int get_nc_fill_values(int ncid, int varid, float *fills, int max);
+
 #endif
 
 
@@ -0,0 +1,149 @@
+/*
+ * @file test_axis.c
+ * @brief Axis cell lookup against find_buffer_idx_clamped.
+ *
+ * Every lookup tier of sjqbn_axis.c, the uniform arithmetic, the
+ * bucket table and the hinted Eytzinger search, must give the cell
+ * find_buffer_idx_clamped gives, for points swept in order, scattered
+ * points, values on and next to the nodes, off either end and NaN.
+ * The shipped model only has uniform and table axes, so this is what
+ * exercises the search.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "sjqbn.h"
+#include "um_netcdf.h"
+
+#define LOOKUPS 50000
+#define THREADS 4
+
+static unsigned int seed = 12345;
+
+static float frand(void) {
+  return rand_r(&seed) / (float)RAND_MAX;
+}
+
+/* values on, next to, between and off the ends of the nodes, and NaN */
+static float pick(float *a, int n, unsigned int *s) {
+  int i = rand_r(s) % n;
+  switch(rand_r(s) % 6) {
+    case 0: return a[i];
+    case 1: return nextafterf(a[i], INFINITY);
+    case 2: return nextafterf(a[i], -INFINITY);
+    case 3: return (rand_r(s) % 64) ? a[0] + (a[n-1] - a[0]) * (rand_r(s) / (float)RAND_MAX) : NAN;
+    case 4: return a[0] - 1 - (rand_r(s) % 100);
+    default: return a[n-1] + 1 + (rand_r(s) % 100);
+  }
+}
+
+static int check(sjqbn_axis_t *axis, float v, long *bad) {
+  int got = sjqbn_axis_cell(axis, v);
+  int want = find_buffer_idx_clamped(axis->values, axis->n, v);
+  if(got != want) {
+    if(*bad < 10) fprintf(stderr, "FAIL n=%d v=%.9g: cell %d, expected %d\n", axis->n, v, got, want);
+    (*bad)++;
+  }
+  return got;
+}
+
+/* scattered points, then a sweep up and back down in small steps */
+static long exercise(sjqbn_axis_t *axis, unsigned int s) {
+  float *a = axis->values;
+  int n = axis->n;
+  long bad = 0;
+
+  for(int k = 0; k < LOOKUPS; k++) check(axis, pick(a, n, &s), &bad);
+
+  float step = (a[n-1] - a[0]) / (LOOKUPS / 2);
+  for(int k = 0; k < LOOKUPS / 2; k++) check(axis, a[0] + k * step, &bad);
+  for(int k = LOOKUPS / 2; k >= 0; k--) check(axis, a[0] + k * step, &bad);
+  return bad;
+}
+
+typedef struct job_t {
+  sjqbn_axis_t *axis;
+  unsigned int seed;
+  long bad;
+} job_t;
+
+static void *run_job(void *arg) {
+  job_t *job = (job_t *)arg;
+  job->bad = exercise(job->axis, job->seed);
+  return NULL;
+}
+
+/* kinds of axes, by the tier they should land on */
+static float *make_axis(int kind, int n) {
+  float *a = (float *)malloc(n * sizeof(float));
+
+  a[0] = -5 * frand();
+  for(int i = 1; i < n; i++) {
+    switch(kind) {
+      case 0: a[i] = a[0] + 0.01f * i; break;                        /* uniform */
+      case 1: a[i] = a[i-1] + 0.5f + 10 * frand(); break;             /* table */
+      default: a[i] = a[i-1] + ((rand_r(&seed) % 4) ? 1e-4f : 50.f) * (1 + frand()); /* searched */
+    }
+  }
+  return a;
+}
+
+int main(void) {
+  static const char *kinds[] = { "uniform", "table", "searched" };
+  long bad = 0;
+
+  for(int kind = 0; kind < 3; kind++) {
+    int axes = 0, searched = 0;
+    for(int n = 2; n < 600; n += (n < 40) ? 1 : 37) {
+      sjqbn_axis_t axis, other;
+      float *a = make_axis(kind, n);
+      float *b = make_axis(kind, n);
+
+      if(setup_sjqbn_axis(&axis, a, n) != SUCCESS || setup_sjqbn_axis(&other, b, n) != SUCCESS) {
+        fprintf(stderr, "FAIL setup of %d nodes\n", n);
+        return 1;
+      }
+      if(!axis.uniform && axis.lut == NULL &&
+         (axis.eytz == NULL || axis.hint_slot < 0 || axis.hint_slot == other.hint_slot)) {
+        fprintf(stderr, "FAIL searched axis of %d nodes: slots %d and %d\n", n, axis.hint_slot, other.hint_slot);
+        bad++;
+      }
+
+      searched += (!axis.uniform && axis.lut == NULL);
+
+      /* two axes in turn, each one's hint must stay its own */
+      unsigned int s = seed;
+      for(int k = 0; k < LOOKUPS / 10; k++) {
+        check(&axis, a[0] + (a[n-1] - a[0]) * k / (LOOKUPS / 10), &bad);
+        check(&other, pick(b, n, &s), &bad);
+      }
+
+      bad += exercise(&axis, seed + n);
+
+      job_t jobs[THREADS];
+      pthread_t threads[THREADS];
+      for(int t = 0; t < THREADS; t++) {
+        jobs[t].axis = &axis;
+        jobs[t].seed = seed + 1000 * t + n;
+        pthread_create(&threads[t], NULL, run_job, &jobs[t]);
+      }
+      for(int t = 0; t < THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        bad += jobs[t].bad;
+      }
+
+      free_sjqbn_axis(&axis);
+      free_sjqbn_axis(&other);
+      free(a);
+      free(b);
+      axes++;
+    }
+    printf("%s axes: %d checked, %d of them searched\n", kinds[kind], axes, searched);
+  }
+
+  printf("%s\n", bad ? "FAIL" : "PASS");
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * @file test_wide_index.c
+ * @brief Node offsets and cell interpolation past 2^31 and 2^32 nodes.
+ *
+ * Builds synthetic datasets larger than INT_MAX nodes in every layout,
+ * on sparse mappings so only the pages written are backed, and checks
+ * the offsets and values the query kernels give for cells around 2^31,
+ * 2^32 and the far corner against a reference computed here.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/mman.h>
+#include "sjqbn.h"
+
+#define SKIP 77
+
+typedef struct grid_t {
+  int nx, ny, nz;
+} grid_t;
+
+/* 2^31 < nodes < 2^32, then past 2^32 */
+static grid_t grids[] = { {2400, 1000, 1000}, {3000, 1500, 1000} };
+static int layouts[] = { SJQBN_LAYOUT_SLAB, SJQBN_LAYOUT_COLUMN, SJQBN_LAYOUT_BRICK };
+static const char *layout_names[] = { "slab", "brick", "column" };
+
+/* offset of a node, worked out independently of sjqbn_util.c */
+static uint64_t ref_offset(sjqbn_dataset_t *d, uint64_t x, uint64_t y, uint64_t z) {
+  if(d->layout == SJQBN_LAYOUT_COLUMN) return (y * d->nx + x) * d->nz + z;
+  if(d->layout == SJQBN_LAYOUT_BRICK) {
+    uint64_t b = 1 << d->brick_shift;
+    uint64_t brick = ((z / b) * d->nby + y / b) * d->nbx + x / b;
+    return brick * b * b * b + ((z % b) * b + y % b) * b + x % b;
+  }
+  return (z * d->ny + y) * d->nx + x;
+}
+
+static float *map_volume(size_t nodes) {
+  void *p = mmap(NULL, nodes * sizeof(float), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return (p == MAP_FAILED) ? NULL : (float *)p;
+}
+
+/* the cell whose first corner is at slab position target, kept inside the grid */
+static void cell_at(sjqbn_dataset_t *d, uint64_t target, sjqbn_pt_info_t *pt) {
+  uint64_t plane = (uint64_t)d->nx * d->ny;
+  int z = target / plane;
+  int y = (target % plane) / d->nx;
+  int x = target % d->nx;
+
+  pt->lon_idx = (x < d->nx-1) ? x : d->nx-2;
+  pt->lat_idx = (y < d->ny-1) ? y : d->ny-2;
+  pt->dep_idx = (z < d->nz-1) ? z : d->nz-2;
+  pt->lon_percent = 0.25;
+  pt->lat_percent = 0.5;
+  pt->dep_percent = 0.75;
+}
+
+static int check_cell(sjqbn_dataset_t *d, sjqbn_pt_info_t *pt) {
+  float corner[8];
+  float expect;
+  sjqbn_properties_t out;
+  int err = 0;
+
+  for(int c = 0; c < 8; c++) {
+    uint64_t off = ref_offset(d, pt->lon_idx + (c & 1), pt->lat_idx + ((c >> 1) & 1), pt->dep_idx + (c >> 2));
+    corner[c] = 100 + 10*c;
+    d->vp_buffer[off] = corner[c];
+    d->vs_buffer[off] = corner[c] / 2;
+    d->rho_buffer[off] = corner[c] / 4;
+  }
+
+  int64_t off = get_one_property(d, pt, &out);
+  uint64_t want = ref_offset(d, pt->lon_idx, pt->lat_idx, pt->dep_idx);
+  if(off != (int64_t)want || out.vp != corner[0] || out.rho != corner[0] / 4) {
+    fprintf(stderr, "FAIL node %d/%d/%d: offset %lld, expected %llu\n",
+            pt->lon_idx, pt->lat_idx, pt->dep_idx, (long long)off, (unsigned long long)want);
+    err++;
+  }
+
+  /* corner c weighs in lon by bit 0, lat by bit 1, depth by bit 2 */
+  expect = 0;
+  for(int c = 0; c < 8; c++) {
+    float w = ((c & 1) ? pt->lon_percent : 1-pt->lon_percent) *
+              (((c >> 1) & 1) ? pt->lat_percent : 1-pt->lat_percent) *
+              ((c >> 2) ? pt->dep_percent : 1-pt->dep_percent);
+    expect += w * corner[c];
+  }
+  get_interp_property(d, pt, &out);
+  if(fabs(out.vp - expect) > 1e-3 || fabs(out.vs - expect / 2) > 1e-3) {
+    fprintf(stderr, "FAIL cell %d/%d/%d: vp %f vs %f, expected %f\n",
+            pt->lon_idx, pt->lat_idx, pt->dep_idx, out.vp, out.vs, expect);
+    err++;
+  }
+  return err;
+}
+
+int main(void) {
+  int err = 0;
+
+  for(size_t g = 0; g < sizeof(grids) / sizeof(grids[0]); g++) {
+    for(size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+      sjqbn_dataset_t *d = (sjqbn_dataset_t *)calloc(1, sizeof(sjqbn_dataset_t));
+      d->nx = grids[g].nx;
+      d->ny = grids[g].ny;
+      d->nz = grids[g].nz;
+      d->precision = SJQBN_PRECISION_FLOAT;
+      setup_sjqbn_layout(d, layouts[l], 16);
+
+      d->vp_buffer = map_volume(d->store_elems);
+      d->vs_buffer = map_volume(d->store_elems);
+      d->rho_buffer = map_volume(d->store_elems);
+      if(d->vp_buffer == NULL || d->vs_buffer == NULL || d->rho_buffer == NULL) {
+        printf("SKIP: no address space for %zu nodes\n", d->store_elems);
+        return SKIP;
+      }
+
+      uint64_t nodes = (uint64_t)d->nx * d->ny * d->nz;
+      uint64_t targets[] = { (1ULL << 31) - 1, 1ULL << 31, (1ULL << 31) + d->nx * 3 + 5,
+                             (1ULL << 32) - 1, (1ULL << 32) + 7, nodes - 1 };
+      int cnt = 0;
+      for(size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        if(targets[t] >= nodes) continue;
+        sjqbn_pt_info_t pt;
+        cell_at(d, targets[t], &pt);
+        err += check_cell(d, &pt);
+        cnt++;
+      }
+      printf("%dx%dx%d %s, %zu stored nodes, %d bit kernel: %d cells checked\n",
+             d->nx, d->ny, d->nz, layout_names[layouts[l]], d->store_elems,
+             d->wide_index ? 64 : 32, cnt);
+
+      munmap(d->vp_buffer, d->store_elems * sizeof(float));
+      munmap(d->vs_buffer, d->store_elems * sizeof(float));
+      munmap(d->rho_buffer, d->store_elems * sizeof(float));
+      free(d);
+    }
+  }
+
+  printf("%s\n", err ? "FAIL" : "PASS");
+  return err ? 1 : 0;
+}